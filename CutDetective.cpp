@@ -1,372 +1,2809 @@
-// Cut Detective looks at differences between frames
-// to detect cuts, then writes an EDL which when
-// relinked to the input clip has cuts on frames
-// with large differences
-//
-// TODO:
-//  o Checkerboard shots into two EDLs, to make commiting shots
-//    with duplicate frames easier?
-//  o Worth multithreading the difference loop?
-//
-// lewis@lewissaunders.com
-
-#include <stdlib.h>
-#include <libgen.h>
-#include "half.h"
-#include "spark.h"
-
-// ID of Spark buffer we use to store previous frame
-int prevframeid;
-
-// We store each frame in a malloc()'d buffer here for retrieval on the next frame
-void *prevframebuffer;
-
-// Whether previous frame is available already
-int haveprev = 0;
-
-// Forward declare callback function for save button click
-unsigned long *savebuttoncallback(int what, SparkInfoStruct si);
-
-// UI controls page 1, controls 6-34
-//  6     13     20     27     34
-//  7     14     21     28
-//  8     15     22     29
-//  9     16     23     30
-//  10    17     24     31
-//  11    18     25     32
-//  12    19     26     33
-SparkFloatStruct SparkFloat21 = {
-  0.0,                          // Value
-  -INFINITY,                    // Min
-  +INFINITY,                    // Max
-  0.1,                          // Increment
-  SPARK_FLAG_NO_INPUT,          // Flags
-  (char *) "Current difference %.2f",   // Title
-  NULL                          // Callback
-};
-SparkBooleanStruct SparkBoolean15 = {
-  1,
-  (char *) "Detect cuts",
-  NULL
-};
-SparkFloatStruct SparkFloat22 = {
-  8.0,                         // Value
-  -INFINITY,                   // Min
-  +INFINITY,                   // Max
-  0.1,                         // Increment
-  0,                           // Flags
-  (char *) "Cut threshold %.2f",   // Title
-  NULL                         // Callback
-};
-SparkBooleanStruct SparkBoolean16 = {
-  0,
-  (char *) "Remove duplicate frames",
-  NULL
-};
-SparkFloatStruct SparkFloat23 = {
-  0.20,                        // Value
-  -INFINITY,                   // Min
-  +INFINITY,                   // Max
-  0.1,                         // Increment
-  0,                           // Flags
-  (char *) "Duplicate threshold %.2f",   // Title
-  NULL                         // Callback
-};
-SparkStringStruct SparkString11 = {
-	"/tmp/cutdetective.edl",
-	(char *) "Save as: %s",
-	0,
-	NULL
-};
-SparkIntStruct SparkInt25 = {
-  24,                          // Value
-  0,                           // Min
-  99,                          // Max
-  1,                           // Increment
-  SPARK_FLAG_NO_ANIM,          // Flags
-  (char *) "FPS %2d",          // Title
-  NULL                         // Callback
-};
-SparkPushStruct SparkPush32 = {
-	(char *) "Save EDL",
-	savebuttoncallback
-};
-SparkIntStruct SparkSetupInt15 = {
-  8,
-  1,
-  128,
-  1,
-  SPARK_FLAG_NO_ANIM,
-  (char *) "Downres factor: %d",
-  NULL
-};
-
-// Check that a Spark image buffer is ready to use
-int bufferReady(int id, SparkMemBufStruct *b) {
-  if(!sparkMemGetBuffer(id, b)) {
-    printf("CutDetective: Failed to get buffer %d\n", id);
-    return 0;
-  }
-  if(!(b->BufState & MEMBUF_LOCKED)) {
-    printf("CutDetective: Failed to lock buffer %d\n", id);
-    return 0;
-  }
-  return 1;
-}
-
-// Flame asks us what extra image buffers we'll want here, we register 1
-void SparkMemoryTempBuffers(void) {
-    prevframeid = sparkMemRegisterBuffer();
-}
-
-// Spark entry function
-unsigned int SparkInitialise(SparkInfoStruct si) {
-  return(SPARK_MODULE);
-}
-
-// Spark entry point for each frame to be rendered
-unsigned long *SparkProcess(SparkInfoStruct si) {
-  // Check Spark image buffers are ready for use
-  SparkMemBufStruct result, front, prevframe;
-  if(!bufferReady(1, &result)) return(NULL);
-  if(!bufferReady(2, &front)) return(NULL);
-
-  sparkCopyBuffer(front.Buffer, result.Buffer);
-
-  return(result.Buffer);
-}
-
-// Spark entry point for each frame analysed
-unsigned long *SparkAnalyse(SparkInfoStruct si) {
-  // Check Spark image buffers are ready for use
-  SparkMemBufStruct result, front, prev;
-  if(!bufferReady(1, &result)) {
-    printf("CutDetective: result buffer not ready at frame %d!\n", si.FrameNo);
-    return(NULL);
-  }
-  if(!bufferReady(2, &front)) {
-    printf("CutDetective: front buffer not ready at frame %d!\n", si.FrameNo);
-    return(NULL);
-  }
-
-	if(haveprev == 0) {
-		// If this is the first frame of the analysis, we won't
-		// have a previous frame buffer stored yet, so fetch it
-    if(!bufferReady(prevframeid, &prev)) {
-      printf("CutDetective: prev buffer not ready at frame %d!\n", si.FrameNo);
-      return(NULL);
-    }
-	  sparkGetFrame(SPARK_FRONT_CLIP, si.FrameNo - 1, prev.Buffer);
-    prevframebuffer = malloc(si.FrameBytes);
-    memcpy(prevframebuffer, prev.Buffer, si.FrameBytes);
-    haveprev = 1;
-	}
-
-  // Loop through pixels, find difference to same pixel
-  // in previous frame, and sum up the differences
-  float totaldifference = 0.0;
-  int downres = SparkSetupInt15.Value;
-  for(int y = 0; y < (front.BufHeight - downres); y += downres) {
-    for(int x = 0; x < (front.BufWidth - downres); x += downres) {
-      char *frontpixel = (char *)(front.Buffer) + y * front.Stride + x * front.Inc;
-      char *prevpixel = (char *)(prevframebuffer) + y * front.Stride + x * front.Inc;
-
-      float r, g, b, l, prevr, prevg, prevb, prevl, difference;
-      switch(front.BufDepth) {
-        case SPARKBUF_RGB_24_3x8:
-          r = *(unsigned char *)(frontpixel + 0) / 255.0;
-          g = *(unsigned char *)(frontpixel + 1) / 255.0;
-          b = *(unsigned char *)(frontpixel + 2) / 255.0;
-          prevr = *(unsigned char *)(prevpixel + 0) / 255.0;
-          prevg = *(unsigned char *)(prevpixel + 1) / 255.0;
-          prevb = *(unsigned char *)(prevpixel + 2) / 255.0;
-          break;
-        case SPARKBUF_RGB_48_3x10:
-        case SPARKBUF_RGB_48_3x12:
-          r = *(unsigned short *)(frontpixel + 0) / 65535.0;
-          g = *(unsigned short *)(frontpixel + 2) / 65535.0;
-          b = *(unsigned short *)(frontpixel + 4) / 65535.0;
-          prevr = *(unsigned short *)(prevpixel + 0) / 65535.0;
-          prevg = *(unsigned short *)(prevpixel + 2) / 65535.0;
-          prevb = *(unsigned short *)(prevpixel + 4) / 65535.0;
-          break;
-        case SPARKBUF_RGB_48_3x16_FP:
-          r = *(half *)(frontpixel + 0);
-          g = *(half *)(frontpixel + 2);
-          b = *(half *)(frontpixel + 4);
-          prevr = *(half *)(prevpixel + 0);
-          prevg = *(half *)(prevpixel + 2);
-          prevb = *(half *)(prevpixel + 4);
-          break;
-				default:
-					break;
-      }
-
-      // Rec709 luma weights
-      l = 0.2126 * r + 0.7152 * g + 0.0722 * b;
-      prevl = 0.2126 * prevr + 0.7152 * prevg + 0.0722 * prevb;
-      difference = fabs(l - prevl);
-      totaldifference += difference;
-    }
-  }
-
-  // Set difference key for this frame
-  float avgdifference = 100.0 * totaldifference / ((front.BufWidth/downres) * (front.BufHeight/downres));
-	SparkFloat21.Value = avgdifference;
-	sparkSetCurveKey(SPARK_UI_CONTROL, 21, si.FrameNo + 1, avgdifference);
-	sparkControlUpdate(21);
-
-	// Copy buffer for next frame
-  memcpy(prevframebuffer, front.Buffer, si.FrameBytes);
-
-  return(front.Buffer);
-}
-
-// Called when Analyse pass finished
-void SparkAnalyseEnd(SparkInfoStruct si) {
-  printf("Analyse end at frame %d\n", si.FrameNo);
-
-  free(prevframebuffer);
-	haveprev = 0;
-
-	// Set a key on the thresholds so the lines appear in the animation window
-	float cutthreshold0 = sparkGetCurveValuef(SPARK_UI_CONTROL, 22, 0);
-	sparkSetCurveKey(SPARK_UI_CONTROL, 22, 0, cutthreshold0);
-	float dupthreshold0 = sparkGetCurveValuef(SPARK_UI_CONTROL, 23, 0);
-	sparkSetCurveKey(SPARK_UI_CONTROL, 23, 0, dupthreshold0);
-}
-
-// Spark deletion entry point
-void SparkUnInitialise(SparkInfoStruct si) {
-}
-
-// Called by Flame to find out what bit-depths we support... all of them :)
-int SparkIsInputFormatSupported(SparkPixelFormat fmt) {
-  switch(fmt) {
-    case SPARKBUF_RGB_24_3x8:
-    case SPARKBUF_RGB_48_3x10:
-    case SPARKBUF_RGB_48_3x12:
-    case SPARKBUF_RGB_48_3x16_FP:
-      return 1;
-      break;
-    default:
-      return 0;
-  }
-}
-
-// Called by Flame to find out how many input clips we require
-int SparkClips(void) {
-  return 1;
-}
-
-// Convert frame count to timecode
-// No drop-frame support, fps must be an integer!
-void frame2tc(int i, char *tc) {
-	int fps = SparkInt25.Value;
-	int h = floor(i/60.0/60.0/fps);
-	int m = floor((i-h*60.0*60.0*fps) / 60.0 / fps);
-	int s = floor((i-h*60.0*60.0*fps - m*60.0*fps) / fps);
-	int f = floor(i-h*60.0*60.0*fps - m*60.0*fps - s * fps);
-	sprintf(tc, "%02d:%02d:%02d:%02d", h, m, s, f);
-}
-
-// Save EDL... button is clicked
-unsigned long *savebuttoncallback(int what, SparkInfoStruct si) {
-	char *path = strdup(SparkString11.Value);
-
-	// Sometimes strings from UI controls come back with a line break
-	int pathlen = strlen(path);
-	if(path[pathlen - 1] == '\n') {
-		path[pathlen - 1] = '\0';
-	}
-
-  // basename() is within its rights to trash its input
-  char *pathdup = strdup(path);
-  char *base = basename(pathdup);
-
-	FILE *fd = fopen(path, "w");
-	fprintf(fd, "TITLE: Cut Detective %s\n", base);
-	fprintf(fd, "%s", "FCM: NON-DROP FRAME\n");
-
-	char *sourcein = (char *) malloc(13);
-	char *sourceout = (char *) malloc(13);
-  char *recordin = (char *) malloc(13);
-  char *recordout = (char *) malloc(13);
-  char *removedtc = (char *) malloc(13);
-  char *cuttc = (char *) malloc(13);
-	int eventno = 1;
-	int prevoutpoint = 0;
-  int removed = 0;
-  int cuts = 0;
-	for(int i = 1; i < si.TotalFrameNo; i++) {
-		float difference = sparkGetCurveValuef(SPARK_UI_CONTROL, 21, i);
-		float cutthreshold = sparkGetCurveValuef(SPARK_UI_CONTROL, 22, i);
-		float dupthreshold = sparkGetCurveValuef(SPARK_UI_CONTROL, 23, i);
-		if(SparkBoolean15.Value == 1 && difference > cutthreshold) {
-      // This frame is the first frame of a new shot, write EDL event for
-      // the shot that just finished
-			frame2tc(prevoutpoint, sourcein);
-			frame2tc(i - 1, sourceout);
-			frame2tc(prevoutpoint - removed, recordin);
-			frame2tc(i - (removed + 1), recordout);
-      if(prevoutpoint != i - 1) {
-        // Only write an event if it wouldn't be zero-length
-        fprintf(fd, "\n%06d  MASTER  V  C  %s %s %s %s\n", eventno, sourcein, sourceout, recordin, recordout);
-  			eventno++;
-        cuts++;
-      }
-      frame2tc(i, cuttc);
-      fprintf(fd, "At end of this shot CutDetective detected a cut at source frame %d, %s\n", i, cuttc);
-			prevoutpoint = i - 1; // Next shot should start on this frame, i.e. a match-cut
-		}
-    if(SparkBoolean16.Value == 1 && difference < dupthreshold && i > 1) {
-      if(prevoutpoint == i - 1) {
-        // We already just finished a shot, don't write a zero-length event
-        // This happens if we're removing multiple dupes in a row
-        removed++;
-        prevoutpoint = i;
-        continue;
-      }
-      // This frame needs to be removed, write EDL event for shot that just
-      // finished
-			frame2tc(prevoutpoint, sourcein);
-			frame2tc(i - 1, sourceout);
-			frame2tc(prevoutpoint - removed, recordin);
-			frame2tc(i - (removed + 1), recordout);
-			fprintf(fd, "\n%06d  MASTER  V  C  %s %s %s %s\n", eventno, sourcein, sourceout, recordin, recordout);
-      frame2tc(i, removedtc);
-      fprintf(fd, "At end of this shot CutDetective removed duplicate source frames at %d, %s\n", i, removedtc);
-      eventno++;
-      removed++;
-      prevoutpoint = i; // Next shot should start on the next frame, not this one
-    }
-	}
-
-	// Don't forget the last shot!
-  int i = si.TotalFrameNo + 1;
-  frame2tc(prevoutpoint, sourcein);
-  frame2tc(i - 1, sourceout);
-  frame2tc(prevoutpoint - removed, recordin);
-  frame2tc(i - (removed + 1), recordout);
-  fprintf(fd, "\n%06d  MASTER  V  C  %s %s %s %s\n", eventno, sourcein, sourceout, recordin, recordout);
-  fprintf(fd, "At end of this shot CutDetective reached end of source\n");
-
-	free(sourcein);
-	free(sourceout);
-  free(recordin);
-  free(recordout);
-  free(removedtc);
-  free(cuttc);
-  free(pathdup);
-
-	fclose(fd);
-
-	// Show a message in the interface
-	char *m = (char *) calloc(1000, 1);
-  float avglen = (float)(i - removed - 1) / (cuts+1);
-  sprintf(m, "%d cuts in %s, average %.1f fr, removed %d duplicates", cuts, path, avglen, removed);
-	sparkMessage(m);
-	free(m);
-
-	return NULL;
-}
+// Cut Detective looks at differences between frames
+// to detect cuts, then writes an EDL which when
+// relinked to the input clip has cuts on frames
+// with large differences
+//
+// TODO:
+//  o Checkerboard shots into two EDLs, to make commiting shots
+//    with duplicate frames easier?
+//  o Worth multithreading the difference loop?
+//
+// lewis@lewissaunders.com
+
+#include <stdlib.h>
+#include <libgen.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include "half.h"
+#ifdef CUTDETECTIVE_OFFLINE
+#include "sparkOffline.h"
+#else
+#include "spark.h"
+#endif
+#include "CutDetective.h"
+#include "CutDetectiveTelemetry.h"
+
+// ID of Spark buffer we use to fetch the frame before the first analysed one
+int prevframeid;
+
+// Rather than keeping the whole previous frame around we keep a low-res
+// thumbnail, one sample per downres x downres block.  The luma difference
+// only ever looked at those samples anyway.  Thumbnails are planar, a luma
+// plane followed by Cb and Cr planes
+float *prevthumb;
+float *thumb;
+int thumbw, thumbh;
+
+// Ring of the last few frames' luma thumbnails, so we can tell a flash
+// frame from a cut by comparing with frames from before the flash.  The
+// entry k frames back from the one being analysed is at ringhead - k
+float *ring;
+int ringsize, ringcount, ringhead;
+
+// Letterbox bars and burnt-in timecode windows are found from the first
+// few frames.  After that the thumbnail only covers the picture inside the
+// bars, starting at roix, roiy in the full sample grid, and roimask marks
+// samples inside that to ignore.  activesamples is how many are left
+int roix, roiy;
+int roiseen;
+float *roimax;
+int *roichurn;
+unsigned char *roimask;
+int activesamples;
+
+// What the luma difference has always been averaged over
+int lumasamples;
+#define ROIBLACK 0.03
+#define ROICHURN 0.8
+#define ROIMASKMAX 0.1
+
+// Luma, Cb and Cr histograms of the current and previous frames, built
+// from the same samples as the thumbnail
+int hist[HISTBINS];
+int prevhist[HISTBINS];
+
+// Edge maps of the current and previous thumbnails' luma, one bit per
+// sample packed into 64-bit words a row at a time, edgewords to a row.
+// edgerow holds a row of gradients and edgegrown the maps grown by a
+// sample each way
+unsigned long long *edges = NULL, *prevedges = NULL;
+unsigned long long *edgegrown = NULL, *prevedgegrown = NULL;
+float *edgerow = NULL;
+int edgewords;
+#define EDGETHRESHOLD 0.1
+#define EDGEFLOOR 0.01
+
+// Tiny RGB copies of every analysed frame's thumbnail for the contact
+// sheet, TILEW x tileh apiece, with tiled saying which frames have one.
+// A long clip has far too many to hold in memory, so they go in a
+// temporary file at a place given by the frame, and only the tiles of the
+// events are read back.  They outlive the analysis so Save EDL can use
+// them, and are kept over several passes of the same clip.  tilefirst is
+// the first frame this analysis saw
+FILE *tilefile = NULL;
+unsigned char *tiled = NULL;
+unsigned char *tile = NULL;
+int tileframes = 0, tileh = 0, tilefirst;
+
+// The heat-map keeps the region of interest and burn-in mask the last
+// analysis found, with the frame size and downres they go with, so it
+// shows what the analysis looked at.  It also keeps the thumbnail of the
+// last frame it drew, so playing forwards never has to fetch the frame
+// before again.  heatkey says what that thumbnail was made with
+int heatroix, heatroiy, heatroiw = 0, heatroih = 0;
+int heatframew, heatframeh, heatdownres;
+unsigned char *heatmask = NULL;
+float *heatthumb = NULL, *heatprev = NULL, *heatsamples = NULL;
+char *heatrow = NULL;
+int heatsize = 0, heatrowbytes = 0;
+int heatframe = -1;
+int heatkey[8];
+
+// Whether previous frame is available already
+int haveprev = 0;
+
+// A run of frames which might turn out to be a dissolve
+typedef struct {
+  int start, last, quiet;
+  float accumulated;
+} DissolveRun;
+
+// Everything we need to write an EDL a frame at a time, so it can be done
+// all at once when Save EDL is clicked or bit by bit while analysing
+typedef struct {
+  FILE *fd;
+  char *path;
+  int eventno;
+  int prevoutpoint;
+  int removed;
+  int dupeend;
+  int cuts;
+  int dissolvecount;
+  int dissolveend;
+  int flashes;
+  int flashend;
+  int *dissolves;
+
+  // Shot table written alongside, if it is, and running totals for the
+  // shot so far.  Motion is the average difference within the shot, and
+  // the stillest frame is a good one to represent it
+  FILE *csv, *json;
+  int shotframes, motionframes, stillest;
+  double lumasum, motionsum;
+  float stillestdiff;
+  int shots;
+
+  // Event number and first frame of each event, for the contact sheet
+  int *sheet;
+  int sheetshots, sheetallocated;
+} EdlWriter;
+
+// EDL being written while we analyse, if we are.  streamnext is the next
+// frame to write and streamfed the next to look at for dissolves
+EdlWriter streamedl;
+int streaming = 0;
+int streamnext, streamfed;
+DissolveRun streamrun;
+
+// Forward declare EDL writing functions used while analysing
+void streamstart(int frames);
+void streamto(int upto, int frames);
+void edlframe(EdlWriter *e, int i, int frames);
+void edlfinish(EdlWriter *e, int frames);
+
+// Checkpoint file of every frame's metrics, so an analysis which was
+// cancelled or crashed can carry on, and frames which haven't changed
+// since the last pass aren't scored again.  It's a header followed by one
+// record per frame, written in place as we go
+#define CHECKMAGIC "CDCHECK6"
+#define CHECKEVERY 25
+typedef struct {
+  char magic[8];
+  int width, height, depth;
+  int downres, radius, history, box;
+  int frames;
+} CheckHeader;
+typedef struct {
+  unsigned long long signature;
+  float tolerance, flashthreshold;
+  int ringcount;
+  int valid;
+  float difference, motion, histogram, chroma, changed;
+  float flash, flashlength;
+  float luma, gain, edges;
+} CheckRecord;
+FILE *checkfd = NULL;
+CheckRecord *checkrecords = NULL;
+int checkframes, checkmatched, checkreused, checkscored;
+
+// Progress published in shared memory while we analyse, if we are, so
+// cutdetectivemonitor can keep an eye on it.  Counts frames over the cut
+// threshold as it goes, before flashes and dissolves are sorted out
+TelemetrySegment *telemetry = NULL;
+char telemetryname[64];
+double telemetrystart;
+int telemetryframes, telemetrycuts;
+
+// Every frame's difference sorted, so we can say how many frames are over
+// or under any threshold with a binary search
+float *sorteddiffs = NULL;
+int nsorted = 0;
+
+// Forward declare callback function for save button click
+unsigned long *savebuttoncallback(int what, SparkInfoStruct si);
+unsigned long *targetshotscallback(int what, SparkInfoStruct si);
+unsigned long *metriccallback(int what, SparkInfoStruct si);
+
+// Rolling window of recent differences for the adaptive thresholds.
+// Values are quantised into bins and counted in a Fenwick tree, so adding,
+// removing and finding the k'th smallest are all O(log bins) whatever the
+// window size
+#define ROLLBINS 16384
+#define ROLLSCALE 100.0
+#define ROLLMAX 1024
+int rolltree[ROLLBINS + 1];
+int rollring[ROLLMAX];
+int rollcount = 0;
+int rollframes = 0;
+
+// Difference metrics the thresholds can be applied to, and the
+// curves they're keyed on
+const char *metricnames[] = {
+  "Luma difference",
+  "Motion-compensated difference",
+  "Histogram distance",
+  "Chroma difference",
+  "Changed pixels",
+  "Gain-invariant difference",
+  "Edge change ratio"
+};
+int metriccontrols[] = { 21, 27, 28, 29, 30, 40, 41 };
+
+// UI controls page 1, controls 6-34
+//  6     13     20     27     34
+//  7     14     21     28
+//  8     15     22     29
+//  9     16     23     30
+//  10    17     24     31
+//  11    18     25     32
+//  12    19     26     33
+SparkFloatStruct SparkFloat6 = {
+  0.0,                          // Value
+  -INFINITY,                    // Min
+  +INFINITY,                    // Max
+  0.1,                          // Increment
+  SPARK_FLAG_NO_INPUT,          // Flags
+  (char *) "Flash difference %.2f",   // Title
+  NULL                          // Callback
+};
+SparkFloatStruct SparkFloat7 = {
+  0.0,                          // Value
+  -INFINITY,                    // Min
+  +INFINITY,                    // Max
+  1.0,                          // Increment
+  SPARK_FLAG_NO_INPUT,          // Flags
+  (char *) "Flash length %.0f",   // Title
+  NULL                          // Callback
+};
+SparkBooleanStruct SparkBoolean8 = {
+  1,
+  (char *) "Ignore flash frames",
+  NULL
+};
+SparkBooleanStruct SparkBoolean9 = {
+  0,
+  (char *) "Show difference heat-map",
+  NULL
+};
+SparkFloatStruct SparkFloat10 = {
+  4.0,                         // Value
+  0.0,                         // Min
+  +INFINITY,                   // Max
+  0.1,                         // Increment
+  0,                           // Flags
+  (char *) "Heat-map gain %.2f",   // Title
+  NULL                         // Callback
+};
+SparkPupStruct SparkPup20 = {
+  0,                            // Value
+  7,                            // Count
+  metricnames,                  // Titles
+  metriccallback                // Callback
+};
+SparkBooleanStruct SparkBoolean17 = {
+  0,
+  (char *) "Adaptive thresholds",
+  NULL
+};
+SparkFloatStruct SparkFloat18 = {
+  0.0,                          // Value
+  -INFINITY,                    // Min
+  +INFINITY,                    // Max
+  0.1,                          // Increment
+  SPARK_FLAG_NO_INPUT,          // Flags
+  (char *) "Adaptive cut threshold %.2f",   // Title
+  NULL                          // Callback
+};
+SparkFloatStruct SparkFloat19 = {
+  0.0,                          // Value
+  -INFINITY,                    // Min
+  +INFINITY,                    // Max
+  0.1,                          // Increment
+  SPARK_FLAG_NO_INPUT,          // Flags
+  (char *) "Adaptive dup threshold %.2f",   // Title
+  NULL                          // Callback
+};
+SparkFloatStruct SparkFloat21 = {
+  0.0,                          // Value
+  -INFINITY,                    // Min
+  +INFINITY,                    // Max
+  0.1,                          // Increment
+  SPARK_FLAG_NO_INPUT,          // Flags
+  (char *) "Current difference %.2f",   // Title
+  NULL                          // Callback
+};
+SparkBooleanStruct SparkBoolean13 = {
+  0,
+  (char *) "Detect dissolves",
+  NULL
+};
+SparkFloatStruct SparkFloat14 = {
+  1.0,                         // Value
+  -INFINITY,                   // Min
+  +INFINITY,                   // Max
+  0.1,                         // Increment
+  0,                           // Flags
+  (char *) "Dissolve threshold %.2f",   // Title
+  NULL                         // Callback
+};
+SparkBooleanStruct SparkBoolean15 = {
+  1,
+  (char *) "Detect cuts",
+  NULL
+};
+SparkFloatStruct SparkFloat22 = {
+  8.0,                         // Value
+  -INFINITY,                   // Min
+  +INFINITY,                   // Max
+  0.1,                         // Increment
+  0,                           // Flags
+  (char *) "Cut threshold %.2f",   // Title
+  NULL                         // Callback
+};
+SparkFloatStruct SparkFloat24 = {
+  6.0,                         // Value
+  0.0,                         // Min
+  +INFINITY,                   // Max
+  0.1,                         // Increment
+  0,                           // Flags
+  (char *) "Adaptive sensitivity %.2f",   // Title
+  NULL                         // Callback
+};
+SparkBooleanStruct SparkBoolean16 = {
+  0,
+  (char *) "Remove duplicate frames",
+  NULL
+};
+SparkFloatStruct SparkFloat23 = {
+  0.20,                        // Value
+  -INFINITY,                   // Min
+  +INFINITY,                   // Max
+  0.1,                         // Increment
+  0,                           // Flags
+  (char *) "Duplicate threshold %.2f",   // Title
+  NULL                         // Callback
+};
+SparkFloatStruct SparkFloat27 = {
+  0.0,                          // Value
+  -INFINITY,                    // Min
+  +INFINITY,                    // Max
+  0.1,                          // Increment
+  SPARK_FLAG_NO_INPUT,          // Flags
+  (char *) "Motion-comp difference %.2f",   // Title
+  NULL                          // Callback
+};
+SparkFloatStruct SparkFloat28 = {
+  0.0,                          // Value
+  -INFINITY,                    // Min
+  +INFINITY,                    // Max
+  0.1,                          // Increment
+  SPARK_FLAG_NO_INPUT,          // Flags
+  (char *) "Histogram distance %.2f",   // Title
+  NULL                          // Callback
+};
+SparkFloatStruct SparkFloat29 = {
+  0.0,                          // Value
+  -INFINITY,                    // Min
+  +INFINITY,                    // Max
+  0.1,                          // Increment
+  SPARK_FLAG_NO_INPUT,          // Flags
+  (char *) "Chroma difference %.2f",   // Title
+  NULL                          // Callback
+};
+SparkFloatStruct SparkFloat30 = {
+  0.0,                          // Value
+  -INFINITY,                    // Min
+  +INFINITY,                    // Max
+  0.1,                          // Increment
+  SPARK_FLAG_NO_INPUT,          // Flags
+  (char *) "Changed pixels %.2f%%",   // Title
+  NULL                          // Callback
+};
+SparkFloatStruct SparkFloat31 = {
+  5.0,                         // Value
+  0.0,                         // Min
+  100.0,                       // Max
+  0.1,                         // Increment
+  0,                           // Flags
+  (char *) "Changed pixel tolerance %.2f",   // Title
+  NULL                         // Callback
+};
+SparkStringStruct SparkString11 = {
+	"/tmp/cutdetective.edl",
+	(char *) "Save as: %s",
+	0,
+	NULL
+};
+SparkIntStruct SparkInt25 = {
+  24,                          // Value
+  0,                           // Min
+  99,                          // Max
+  1,                           // Increment
+  SPARK_FLAG_NO_ANIM,          // Flags
+  (char *) "FPS %2d",          // Title
+  NULL                         // Callback
+};
+SparkBooleanStruct SparkBoolean12 = {
+  0,
+  (char *) "Write EDL while analysing",
+  NULL
+};
+SparkIntStruct SparkInt26 = {
+  0,                           // Value
+  0,                           // Min
+  100000,                      // Max
+  1,                           // Increment
+  SPARK_FLAG_NO_ANIM,          // Flags
+  (char *) "Target shots %d",  // Title
+  targetshotscallback          // Callback
+};
+SparkFloatStruct SparkFloat33 = {
+  0.0,                          // Value
+  -INFINITY,                    // Min
+  +INFINITY,                    // Max
+  1.0,                          // Increment
+  SPARK_FLAG_NO_INPUT,          // Flags
+  (char *) "Cuts at this difference %.0f",   // Title
+  NULL                          // Callback
+};
+// UI controls page 2, controls 35-63
+//  35
+//  36
+//  37
+//  38
+//  39
+//  40
+//  41
+//  42    43
+SparkBooleanStruct SparkBoolean35 = {
+  0,
+  (char *) "Checkpoint analysis",
+  NULL
+};
+SparkStringStruct SparkString36 = {
+	"/tmp/cutdetective.cdcheck",
+	(char *) "Checkpoint: %s",
+	0,
+	NULL
+};
+SparkBooleanStruct SparkBoolean37 = {
+  0,
+  (char *) "Publish progress",
+  NULL
+};
+SparkFloatStruct SparkFloat38 = {
+  0.0,                          // Value
+  -INFINITY,                    // Min
+  +INFINITY,                    // Max
+  0.1,                          // Increment
+  SPARK_FLAG_NO_INPUT,          // Flags
+  (char *) "Mean luma %.2f%%",  // Title
+  NULL                          // Callback
+};
+SparkBooleanStruct SparkBoolean39 = {
+  0,
+  (char *) "Write shot table",
+  NULL
+};
+SparkFloatStruct SparkFloat40 = {
+  0.0,                          // Value
+  -INFINITY,                    // Min
+  +INFINITY,                    // Max
+  0.1,                          // Increment
+  SPARK_FLAG_NO_INPUT,          // Flags
+  (char *) "Gain-invariant difference %.2f",   // Title
+  NULL                          // Callback
+};
+SparkFloatStruct SparkFloat41 = {
+  0.0,                          // Value
+  -INFINITY,                    // Min
+  +INFINITY,                    // Max
+  0.1,                          // Increment
+  SPARK_FLAG_NO_INPUT,          // Flags
+  (char *) "Edge change ratio %.2f",   // Title
+  NULL                          // Callback
+};
+SparkBooleanStruct SparkBoolean42 = {
+  0,
+  (char *) "Write contact sheet",
+  NULL
+};
+SparkFloatStruct SparkFloat43 = {
+  6.0,                         // Value
+  0.0,                         // Min
+  +INFINITY,                   // Max
+  0.1,                         // Increment
+  0,                           // Flags
+  (char *) "Flash tolerance %.2f",   // Title
+  NULL                         // Callback
+};
+SparkPushStruct SparkPush32 = {
+	(char *) "Save EDL",
+	savebuttoncallback
+};
+SparkIntStruct SparkSetupInt15 = {
+  8,
+  1,
+  128,
+  1,
+  SPARK_FLAG_NO_ANIM,
+  (char *) "Downres factor: %d",
+  NULL
+};
+SparkIntStruct SparkSetupInt16 = {
+  2,
+  0,
+  16,
+  1,
+  SPARK_FLAG_NO_ANIM,
+  (char *) "Motion search radius: %d",
+  NULL
+};
+SparkIntStruct SparkSetupInt17 = {
+  25,
+  3,
+  ROLLMAX,
+  1,
+  SPARK_FLAG_NO_ANIM,
+  (char *) "Adaptive window: %d frames",
+  NULL
+};
+SparkIntStruct SparkSetupInt18 = {
+  4,
+  2,
+  250,
+  1,
+  SPARK_FLAG_NO_ANIM,
+  (char *) "Shortest dissolve: %d frames",
+  NULL
+};
+SparkIntStruct SparkSetupInt19 = {
+  0,
+  0,
+  250,
+  1,
+  SPARK_FLAG_NO_ANIM,
+  (char *) "Find letterbox and burn-ins over: %d frames",
+  NULL
+};
+SparkIntStruct SparkSetupInt20 = {
+  4,
+  2,
+  16,
+  1,
+  SPARK_FLAG_NO_ANIM,
+  (char *) "Flash history: %d frames",
+  NULL
+};
+SparkIntStruct SparkSetupInt21 = {
+  0,
+  0,
+  1,
+  1,
+  SPARK_FLAG_NO_ANIM,
+  (char *) "Box filter thumbnails: %d",
+  NULL
+};
+
+// Size in thumbnail samples of the blocks we motion search
+#define MOTIONBLOCK 8
+
+// Check that a Spark image buffer is ready to use
+int bufferReady(int id, SparkMemBufStruct *b) {
+  if(!sparkMemGetBuffer(id, b)) {
+    printf("CutDetective: Failed to get buffer %d\n", id);
+    return 0;
+  }
+  if(!(b->BufState & MEMBUF_LOCKED)) {
+    printf("CutDetective: Failed to lock buffer %d\n", id);
+    return 0;
+  }
+  return 1;
+}
+
+// Read a pixel in any of the formats we support as float RGB
+void readpixel(char *pixel, int depth, float *r, float *g, float *b) {
+  switch(depth) {
+    case SPARKBUF_RGB_24_3x8:
+      *r = *(unsigned char *)(pixel + 0) / 255.0;
+      *g = *(unsigned char *)(pixel + 1) / 255.0;
+      *b = *(unsigned char *)(pixel + 2) / 255.0;
+      break;
+    case SPARKBUF_RGB_48_3x10:
+    case SPARKBUF_RGB_48_3x12:
+      *r = *(unsigned short *)(pixel + 0) / 65535.0;
+      *g = *(unsigned short *)(pixel + 2) / 65535.0;
+      *b = *(unsigned short *)(pixel + 4) / 65535.0;
+      break;
+    case SPARKBUF_RGB_48_3x16_FP:
+      *r = *(half *)(pixel + 0);
+      *g = *(half *)(pixel + 2);
+      *b = *(half *)(pixel + 4);
+      break;
+    default:
+      *r = *g = *b = 0.0;
+      break;
+  }
+}
+
+// Write float RGB as a pixel in any of the formats we support, returning
+// how many bytes it took
+int writepixel(char *pixel, int depth, float r, float g, float b) {
+  switch(depth) {
+    case SPARKBUF_RGB_24_3x8:
+      *(unsigned char *)(pixel + 0) = r * 255.0 + 0.5;
+      *(unsigned char *)(pixel + 1) = g * 255.0 + 0.5;
+      *(unsigned char *)(pixel + 2) = b * 255.0 + 0.5;
+      return 3;
+    case SPARKBUF_RGB_48_3x10:
+    case SPARKBUF_RGB_48_3x12:
+      *(unsigned short *)(pixel + 0) = r * 65535.0 + 0.5;
+      *(unsigned short *)(pixel + 2) = g * 65535.0 + 0.5;
+      *(unsigned short *)(pixel + 4) = b * 65535.0 + 0.5;
+      return 6;
+    case SPARKBUF_RGB_48_3x16_FP:
+      *(half *)(pixel + 0) = r;
+      *(half *)(pixel + 2) = g;
+      *(half *)(pixel + 4) = b;
+      return 6;
+    default:
+      return 0;
+  }
+}
+
+// Which histogram bin a value in 0-1 falls in, clamping out of range values
+int histbin(float v, int bins) {
+  int bin = v * bins;
+  if(bin < 0) return 0;
+  if(bin >= bins) return bins - 1;
+  return bin;
+}
+
+// Count one thumbnail sample into the luma and chroma histograms
+void histcount(int *h, float l, float cb, float cr) {
+  h[histbin(l, LUMABINS)]++;
+  h[LUMABINS + histbin(cb + 0.5, CHROMABINS)]++;
+  h[LUMABINS + CHROMABINS + histbin(cr + 0.5, CHROMABINS)]++;
+}
+
+// Add n channel values from one row of a Spark buffer into running column
+// sums, integer for the integer formats.  Plain loops over contiguous
+// memory, so they vectorise
+void boxrow(char *row, int depth, int n, unsigned int *sums, float *fsums) {
+  switch(depth) {
+    case SPARKBUF_RGB_24_3x8: {
+      unsigned char *p = (unsigned char *) row;
+      for(int i = 0; i < n; i++) {
+        sums[i] += p[i];
+      }
+      break;
+    }
+    case SPARKBUF_RGB_48_3x10:
+    case SPARKBUF_RGB_48_3x12: {
+      unsigned short *p = (unsigned short *) row;
+      for(int i = 0; i < n; i++) {
+        sums[i] += p[i];
+      }
+      break;
+    }
+    case SPARKBUF_RGB_48_3x16_FP: {
+      half *p = (half *) row;
+      for(int i = 0; i < n; i++) {
+        fsums[i] += p[i];
+      }
+      break;
+    }
+  }
+}
+
+// Column sums for boxthumb, kept between frames rather than allocated for
+// each one, and only grown when a wider thumbnail needs more
+unsigned int *boxsums = NULL;
+float *boxfsums = NULL;
+int boxcolumns = 0;
+
+void boxfree(void) {
+  free(boxsums);
+  free(boxfsums);
+  boxsums = NULL;
+  boxfsums = NULL;
+  boxcolumns = 0;
+}
+
+// Average each downres x downres block of a Spark buffer into a thumbnail
+// sample, rather than taking one pixel from it.  Fine detail and grain
+// average out instead of aliasing into the differences.  Each row is read
+// from start to finish, which is what the prefetcher likes, into column
+// sums which are only added across once every downres rows
+void boxthumb(SparkMemBufStruct *buf, int downres, float *t, int *h) {
+  int n = thumbw * thumbh;
+  int columns = 3 * thumbw * downres;
+  if(columns > boxcolumns) {
+    boxfree();
+    boxsums = (unsigned int *) malloc(columns * sizeof(unsigned int));
+    boxfsums = (float *) malloc(columns * sizeof(float));
+    boxcolumns = columns;
+  }
+  unsigned int *sums = boxsums;
+  float *fsums = boxfsums;
+  int fp = buf->BufDepth == SPARKBUF_RGB_48_3x16_FP;
+  float scale = 1.0 / (downres * downres);
+  if(buf->BufDepth == SPARKBUF_RGB_24_3x8) {
+    scale /= 255.0;
+  } else if(!fp) {
+    scale /= 65535.0;
+  }
+  memset(h, 0, HISTBINS * sizeof(int));
+  for(int ty = 0; ty < thumbh; ty++) {
+    memset(sums, 0, columns * sizeof(unsigned int));
+    memset(fsums, 0, columns * sizeof(float));
+    for(int k = 0; k < downres; k++) {
+      char *row = (char *)(buf->Buffer) + ((roiy + ty) * downres + k) * buf->Stride + roix * downres * buf->Inc;
+      boxrow(row, buf->BufDepth, columns, sums, fsums);
+    }
+    for(int tx = 0; tx < thumbw; tx++) {
+      if(roimask != NULL && roimask[ty * thumbw + tx]) {
+        t[ty * thumbw + tx] = t[n + ty * thumbw + tx] = t[2 * n + ty * thumbw + tx] = 0.0;
+        continue;
+      }
+      float r = 0.0, g = 0.0, b = 0.0;
+      for(int k = 3 * tx * downres; k < 3 * (tx + 1) * downres; k += 3) {
+        r += fp ? fsums[k + 0] : sums[k + 0];
+        g += fp ? fsums[k + 1] : sums[k + 1];
+        b += fp ? fsums[k + 2] : sums[k + 2];
+      }
+      r *= scale;
+      g *= scale;
+      b *= scale;
+      float l = 0.2126 * r + 0.7152 * g + 0.0722 * b;
+      float cb = (b - l) / 1.8556;
+      float cr = (r - l) / 1.5748;
+      t[ty * thumbw + tx] = l;
+      t[n + ty * thumbw + tx] = cb;
+      t[2 * n + ty * thumbw + tx] = cr;
+      histcount(h, l, cb, cr);
+    }
+  }
+}
+
+// Point sample a Spark buffer every downres pixels into a thumbnail, and
+// count the samples into luma and chroma histograms while we're there.
+// Masked samples are left black in every frame so they never differ
+void makethumb(SparkMemBufStruct *buf, int downres, float *t, int *h) {
+  // The box filter reads rows as plain arrays, so needs packed pixels
+  int packed = buf->Inc == (buf->BufDepth == SPARKBUF_RGB_24_3x8 ? 3 : 6);
+  if(SparkSetupInt21.Value == 1 && packed) {
+    boxthumb(buf, downres, t, h);
+    return;
+  }
+  int n = thumbw * thumbh;
+  memset(h, 0, HISTBINS * sizeof(int));
+  for(int ty = 0; ty < thumbh; ty++) {
+    for(int tx = 0; tx < thumbw; tx++) {
+      if(roimask != NULL && roimask[ty * thumbw + tx]) {
+        t[ty * thumbw + tx] = t[n + ty * thumbw + tx] = t[2 * n + ty * thumbw + tx] = 0.0;
+        continue;
+      }
+      char *pixel = (char *)(buf->Buffer) + (roiy + ty) * downres * buf->Stride + (roix + tx) * downres * buf->Inc;
+      float r, g, b;
+      readpixel(pixel, buf->BufDepth, &r, &g, &b);
+
+      // Rec709 luma weights, and colour difference scaling which
+      // puts Cb and Cr in -0.5 to 0.5
+      float l = 0.2126 * r + 0.7152 * g + 0.0722 * b;
+      float cb = (b - l) / 1.8556;
+      float cr = (r - l) / 1.5748;
+      t[ty * thumbw + tx] = l;
+      t[n + ty * thumbw + tx] = cb;
+      t[2 * n + ty * thumbw + tx] = cr;
+      histcount(h, l, cb, cr);
+    }
+  }
+}
+
+void tilefree(void) {
+  if(tilefile != NULL) fclose(tilefile);
+  free(tiled);
+  free(tile);
+  tilefile = NULL;
+  tiled = tile = NULL;
+  tileframes = 0;
+}
+
+// Make room for a tile of every frame in the clip, the shape of the
+// thumbnails as they are now, unless we already have room from an earlier
+// pass over it
+void tilestart(int frames) {
+  int h = (TILEW * thumbh + thumbw / 2) / thumbw;
+  if(h < 1) h = 1;
+  if(tilefile != NULL && tileframes == frames && tileh == h) return;
+  tilefree();
+  tileh = h;
+  tileframes = frames;
+  tilefile = tmpfile();
+  tiled = (unsigned char *) calloc(frames, 1);
+  tile = (unsigned char *) malloc(TILEW * tileh * 3);
+  if(tilefile == NULL || tiled == NULL || tile == NULL) {
+    printf("CutDetective: Failed to make a file for contact sheet tiles\n");
+    tilefree();
+  }
+}
+
+// Put frame's tile, which is in tile, in the file or get it back from
+// there.  Returns 0 if it can't
+int tilewrite(int frame) {
+  if(tilefile == NULL || frame < 0 || frame >= tileframes) return 0;
+  fseek(tilefile, (long) frame * TILEW * tileh * 3, SEEK_SET);
+  if(fwrite(tile, TILEW * tileh * 3, 1, tilefile) != 1) return 0;
+  tiled[frame] = 1;
+  return 1;
+}
+
+int tileread(int frame) {
+  if(tilefile == NULL || frame < 0 || frame >= tileframes || !tiled[frame]) return 0;
+  fseek(tilefile, (long) frame * TILEW * tileh * 3, SEEK_SET);
+  return fread(tile, TILEW * tileh * 3, 1, tilefile) == 1;
+}
+
+// Shrink a thumbnail to frame's tile, averaging the samples under each
+// tile pixel and going back to RGB
+void tilekeep(int frame, float *t) {
+  if(tilefile == NULL || frame < 0 || frame >= tileframes) return;
+  int n = thumbw * thumbh;
+  unsigned char *out = tile;
+  for(int y = 0; y < tileh; y++) {
+    int y0 = y * thumbh / tileh, y1 = (y + 1) * thumbh / tileh;
+    if(y1 <= y0) y1 = y0 + 1;
+    for(int x = 0; x < TILEW; x++) {
+      int x0 = x * thumbw / TILEW, x1 = (x + 1) * thumbw / TILEW;
+      if(x1 <= x0) x1 = x0 + 1;
+      float l = 0.0, cb = 0.0, cr = 0.0;
+      for(int sy = y0; sy < y1; sy++) {
+        for(int sx = x0; sx < x1; sx++) {
+          l += t[sy * thumbw + sx];
+          cb += t[n + sy * thumbw + sx];
+          cr += t[2 * n + sy * thumbw + sx];
+        }
+      }
+      float count = (x1 - x0) * (y1 - y0);
+      l /= count;
+      cb /= count;
+      cr /= count;
+      float rgb[3];
+      rgb[0] = l + 1.5748 * cr;
+      rgb[2] = l + 1.8556 * cb;
+      rgb[1] = (l - 0.2126 * rgb[0] - 0.0722 * rgb[2]) / 0.7152;
+      for(int c = 0; c < 3; c++) {
+        float v = rgb[c] * 255.0 + 0.5;
+        *out++ = v < 0.0 ? 0 : v > 255.0 ? 255 : (unsigned char) v;
+      }
+    }
+  }
+  tilewrite(frame);
+}
+
+// Letterbox finding changes the shape of the thumbnails, so tiles aren't
+// made until it's done.  Then the frames it looked at are read again,
+// cropped, to make theirs
+void tilecatchup(int first, int last, int downres) {
+  SparkMemBufStruct buf;
+  if(tilefile == NULL || !bufferReady(prevframeid, &buf)) return;
+  for(int frame = first > 0 ? first : 0; frame <= last; frame++) {
+    sparkGetFrame(SPARK_FRONT_CLIP, frame, buf.Buffer);
+    makethumb(&buf, downres, thumb, hist);
+    tilekeep(frame, thumb);
+  }
+}
+
+// While we're still looking for the region of interest, note how bright
+// each sample gets and how often it changes
+void roilearn(float tolerance) {
+  for(int i = 0; i < thumbw * thumbh; i++) {
+    if(thumb[i] > roimax[i]) roimax[i] = thumb[i];
+    if(fabsf(thumb[i] - prevthumb[i]) > tolerance) roichurn[i]++;
+  }
+  roiseen++;
+}
+
+// Decide on the region of interest from what roilearn() saw, then crop the
+// previous frame's thumbnail to match and recount its histograms.  Rows and
+// columns at the edges which never got brighter than black are letterbox
+// or pillarbox bars.  Small patches which changed on nearly every frame are
+// burnt-in timecode or frame counters, so we mask them off, but if there's
+// lots of that it's just a busy shot and we leave it be
+void roifinish(void) {
+  int top = 0, bottom = thumbh, left = 0, right = thumbw;
+  for(; top < bottom; top++) {
+    int black = 1;
+    for(int x = 0; x < thumbw; x++) black &= roimax[top * thumbw + x] < ROIBLACK;
+    if(!black) break;
+  }
+  for(; bottom > top; bottom--) {
+    int black = 1;
+    for(int x = 0; x < thumbw; x++) black &= roimax[(bottom - 1) * thumbw + x] < ROIBLACK;
+    if(!black) break;
+  }
+  for(; left < right; left++) {
+    int black = 1;
+    for(int y = top; y < bottom; y++) black &= roimax[y * thumbw + left] < ROIBLACK;
+    if(!black) break;
+  }
+  for(; right > left; right--) {
+    int black = 1;
+    for(int y = top; y < bottom; y++) black &= roimax[y * thumbw + right - 1] < ROIBLACK;
+    if(!black) break;
+  }
+
+  // A fade up from black would look like one big letterbox
+  if((bottom - top) * (right - left) < thumbw * thumbh / 4) {
+    top = left = 0;
+    bottom = thumbh;
+    right = thumbw;
+  }
+
+  // Samples that churned on nearly every frame, grown by one sample so we
+  // catch the edges of the characters too
+  int w = right - left, h = bottom - top;
+  unsigned char *mask = (unsigned char *) calloc(w * h, 1);
+  int masked = 0;
+  for(int y = 0; y < h; y++) {
+    for(int x = 0; x < w; x++) {
+      if(roichurn[(top + y) * thumbw + left + x] < ROICHURN * roiseen) continue;
+      for(int my = y - 1; my <= y + 1; my++) {
+        for(int mx = x - 1; mx <= x + 1; mx++) {
+          if(my < 0 || my >= h || mx < 0 || mx >= w || mask[my * w + mx]) continue;
+          mask[my * w + mx] = 1;
+          masked++;
+        }
+      }
+    }
+  }
+  if(masked == 0 || masked > ROIMASKMAX * w * h) {
+    free(mask);
+    mask = NULL;
+    masked = 0;
+  }
+
+  // Crop the previous thumbnail in place, plane by plane
+  int n = thumbw * thumbh;
+  for(int p = 0; p < 3; p++) {
+    for(int y = 0; y < h; y++) {
+      memmove(prevthumb + p * w * h + y * w, prevthumb + p * n + (top + y) * thumbw + left, w * sizeof(float));
+    }
+  }
+  memset(prevhist, 0, sizeof(prevhist));
+  for(int i = 0; i < w * h; i++) {
+    if(mask != NULL && mask[i]) {
+      prevthumb[i] = prevthumb[w * h + i] = prevthumb[2 * w * h + i] = 0.0;
+      continue;
+    }
+    histcount(prevhist, prevthumb[i], prevthumb[w * h + i], prevthumb[2 * w * h + i]);
+  }
+
+  printf("CutDetective: region of interest %d,%d %dx%d samples, %d masked\n", left, top, w, h, masked);
+  roix = left;
+  roiy = top;
+  thumbw = w;
+  thumbh = h;
+  roimask = mask;
+  activesamples = w * h - masked;
+  free(roimax);
+  free(roichurn);
+  roimax = NULL;
+  roichurn = NULL;
+}
+
+// Fraction of samples which would have to move bin to turn one histogram
+// into the other, averaged over the channels with luma counting double
+float histdistance(int *h, int *prevh) {
+  int luma = 0, cb = 0, cr = 0;
+  for(int i = 0; i < LUMABINS; i++) {
+    luma += abs(h[i] - prevh[i]);
+  }
+  for(int i = LUMABINS; i < LUMABINS + CHROMABINS; i++) {
+    cb += abs(h[i] - prevh[i]);
+  }
+  for(int i = LUMABINS + CHROMABINS; i < HISTBINS; i++) {
+    cr += abs(h[i] - prevh[i]);
+  }
+  float samples = 2.0 * activesamples;
+  return 100.0 * (0.5 * luma + 0.25 * cb + 0.25 * cr) / samples;
+}
+
+// Compare every sample of thumbnail t with the previous one p in a single
+// pass, summing the luma and chroma differences and counting samples whose
+// luma changed by more than tolerance.  Sums are kept in separate lanes so
+// the compiler is free to vectorise the loop.  If samples isn't NULL each
+// sample's luma difference is kept there too, for the heat-map
+#define LANES 8
+void thumbdifferences(float *t, float *p, float tolerance, float *luma, float *chroma, int *changed, float *samples) {
+  int n = thumbw * thumbh;
+  float lumalanes[LANES] = { 0.0 }, chromalanes[LANES] = { 0.0 };
+  int changedlanes[LANES] = { 0 };
+  int i = 0;
+  for(; i + LANES <= n; i += LANES) {
+    for(int j = 0; j < LANES; j++) {
+      float dl = fabsf(t[i + j] - p[i + j]);
+      float dc = fabsf(t[n + i + j] - p[n + i + j]) + fabsf(t[2 * n + i + j] - p[2 * n + i + j]);
+      lumalanes[j] += dl;
+      chromalanes[j] += dc;
+      changedlanes[j] += dl > tolerance;
+      if(samples != NULL) samples[i + j] = dl;
+    }
+  }
+  for(int j = 0; i + j < n; j++) {
+    float dl = fabsf(t[i + j] - p[i + j]);
+    float dc = fabsf(t[n + i + j] - p[n + i + j]) + fabsf(t[2 * n + i + j] - p[2 * n + i + j]);
+    lumalanes[j] += dl;
+    chromalanes[j] += dc;
+    changedlanes[j] += dl > tolerance;
+    if(samples != NULL) samples[i + j] = dl;
+  }
+  *luma = *chroma = 0.0;
+  *changed = 0;
+  for(int j = 0; j < LANES; j++) {
+    *luma += lumalanes[j];
+    *chroma += chromalanes[j];
+    *changed += changedlanes[j];
+  }
+}
+
+// Luma difference once this frame's brightness and contrast are matched
+// to the previous frame's, so flicker, lightning and exposure ramps score
+// low.  Matching l to the previous frame p means scaling it by sd(p) /
+// sd(l) about its mean, and the RMS difference that leaves works out as
+// sd(p) * sqrt(2 * (1 - correlation)).  So all we need are the means,
+// variances and covariance, which one pass over both thumbnails gives us.
+// Masked samples are black in both so add nothing to any of the sums
+float gaindifference(void) {
+  int n = thumbw * thumbh;
+  double l[LANES] = { 0.0 }, ll[LANES] = { 0.0 }, p[LANES] = { 0.0 }, pp[LANES] = { 0.0 }, lp[LANES] = { 0.0 };
+  int i = 0;
+  for(; i + LANES <= n; i += LANES) {
+    for(int j = 0; j < LANES; j++) {
+      double a = thumb[i + j], b = prevthumb[i + j];
+      l[j] += a;
+      ll[j] += a * a;
+      p[j] += b;
+      pp[j] += b * b;
+      lp[j] += a * b;
+    }
+  }
+  for(int j = 0; i + j < n; j++) {
+    double a = thumb[i + j], b = prevthumb[i + j];
+    l[j] += a;
+    ll[j] += a * a;
+    p[j] += b;
+    pp[j] += b * b;
+    lp[j] += a * b;
+  }
+  for(int j = 1; j < LANES; j++) {
+    l[0] += l[j];
+    ll[0] += ll[j];
+    p[0] += p[j];
+    pp[0] += pp[j];
+    lp[0] += lp[j];
+  }
+  double lmean = l[0] / activesamples, pmean = p[0] / activesamples;
+  double lvar = ll[0] / activesamples - lmean * lmean;
+  double pvar = pp[0] / activesamples - pmean * pmean;
+  double cov = lp[0] / activesamples - lmean * pmean;
+  if(lvar < 1e-8 || pvar < 1e-8) {
+    // A flat frame has no contrast to match, so only match brightness
+    double v = lvar + pvar - 2.0 * cov;
+    return 100.0 * sqrt(v > 0.0 ? v : 0.0);
+  }
+  double correlation = cov / sqrt(lvar * pvar);
+  double v = 2.0 * pvar * (1.0 - correlation);
+  return 100.0 * sqrt(v > 0.0 ? v : 0.0);
+}
+
+// Make room for edge maps the size of the thumbnail
+void edgealloc(void) {
+  free(edges);
+  free(prevedges);
+  free(edgegrown);
+  free(prevedgegrown);
+  free(edgerow);
+  edgewords = (thumbw + 63) / 64;
+  edges = (unsigned long long *) calloc(edgewords * thumbh, sizeof(unsigned long long));
+  prevedges = (unsigned long long *) calloc(edgewords * thumbh, sizeof(unsigned long long));
+  edgegrown = (unsigned long long *) calloc(edgewords * thumbh, sizeof(unsigned long long));
+  prevedgegrown = (unsigned long long *) calloc(edgewords * thumbh, sizeof(unsigned long long));
+  edgerow = (float *) calloc(thumbw, sizeof(float));
+}
+
+void edgefree(void) {
+  free(edges);
+  free(prevedges);
+  free(edgegrown);
+  free(prevedgegrown);
+  free(edgerow);
+  edges = prevedges = edgegrown = prevedgegrown = NULL;
+  edgerow = NULL;
+}
+
+// Whether any sample around x, y is masked out, in which case the black
+// we put there would look like an edge
+int edgemasked(int x, int y) {
+  for(int dy = -1; dy <= 1; dy++) {
+    for(int dx = -1; dx <= 1; dx++) {
+      if(roimask[(y + dy) * thumbw + x + dx]) return 1;
+    }
+  }
+  return 0;
+}
+
+// Mark samples of a thumbnail's luma where a Sobel filter finds an edge.
+// The threshold goes up and down with the frame's average brightness, so
+// the same edges are found as the exposure changes, but not so low that
+// noise in black frames counts.  Each row's gradients are worked out in a
+// loop of their own so it vectorises, then packed into bits.  The
+// outermost samples have nothing on one side so are never edges
+void edgemap(float *t, unsigned long long *e) {
+  memset(e, 0, edgewords * thumbh * sizeof(unsigned long long));
+  float sum = 0.0;
+  for(int i = 0; i < thumbw * thumbh; i++) {
+    sum += t[i];
+  }
+  float threshold = EDGETHRESHOLD * sum / activesamples;
+  if(threshold < EDGEFLOOR) threshold = EDGEFLOOR;
+  for(int y = 1; y < thumbh - 1; y++) {
+    float *above = t + (y - 1) * thumbw, *row = t + y * thumbw, *below = t + (y + 1) * thumbw;
+    for(int x = 1; x < thumbw - 1; x++) {
+      float gx = (above[x + 1] + 2.0f * row[x + 1] + below[x + 1]) - (above[x - 1] + 2.0f * row[x - 1] + below[x - 1]);
+      float gy = (below[x - 1] + 2.0f * below[x] + below[x + 1]) - (above[x - 1] + 2.0f * above[x] + above[x + 1]);
+      edgerow[x] = 0.125f * (fabsf(gx) + fabsf(gy));
+    }
+    unsigned long long *bits = e + y * edgewords;
+    for(int x = 1; x < thumbw - 1; x++) {
+      if(edgerow[x] > threshold && (roimask == NULL || !edgemasked(x, y))) {
+        bits[x / 64] |= 1ULL << (x % 64);
+      }
+    }
+  }
+}
+
+// Grow an edge map by a sample left and right, carrying across words
+void edgegrow(unsigned long long *e, unsigned long long *grown) {
+  for(int y = 0; y < thumbh; y++) {
+    unsigned long long *row = e + y * edgewords, *out = grown + y * edgewords;
+    for(int w = 0; w < edgewords; w++) {
+      unsigned long long left = w > 0 ? row[w - 1] >> 63 : 0;
+      unsigned long long right = w < edgewords - 1 ? row[w + 1] << 63 : 0;
+      out[w] = row[w] | (row[w] << 1) | left | (row[w] >> 1) | right;
+    }
+  }
+}
+
+// Edges in e more than a sample away from any in grown, which has been
+// grown sideways already so we only need to look at the rows either side
+int edgesaway(unsigned long long *e, unsigned long long *grown) {
+  int away = 0;
+  for(int y = 0; y < thumbh; y++) {
+    unsigned long long *row = e + y * edgewords;
+    unsigned long long *near = grown + y * edgewords;
+    unsigned long long *above = y > 0 ? near - edgewords : near;
+    unsigned long long *below = y < thumbh - 1 ? near + edgewords : near;
+    for(int w = 0; w < edgewords; w++) {
+      away += __builtin_popcountll(row[w] & ~(near[w] | above[w] | below[w]));
+    }
+  }
+  return away;
+}
+
+// Edge change ratio between the previous frame's edges and this one's.
+// Edges which appear away from any old edge are entering, and old ones
+// with no new edge nearby are exiting.  The ratio is whichever is the
+// bigger fraction of its frame's edges, so a lighting change which keeps
+// the same edges scores low but a cut, which swaps them all, scores high
+float edgechange(void) {
+  int count = 0, prevcount = 0;
+  for(int i = 0; i < edgewords * thumbh; i++) {
+    count += __builtin_popcountll(edges[i]);
+    prevcount += __builtin_popcountll(prevedges[i]);
+  }
+  edgegrow(edges, edgegrown);
+  edgegrow(prevedges, prevedgegrown);
+  int entering = edgesaway(edges, prevedgegrown);
+  int exiting = edgesaway(prevedges, edgegrown);
+  float inratio = count > 0 ? (float) entering / count : 0.0;
+  float outratio = prevcount > 0 ? (float) exiting / prevcount : 0.0;
+  return 100.0 * (inratio > outratio ? inratio : outratio);
+}
+
+// Compare this frame with each frame in the history ring from two back.
+// After a flash the picture goes back to how it was before, so one of these
+// is low even though the frame-to-frame difference isn't.  We want the most
+// recent frame that's closer than threshold, or failing that the closest.
+// length is set to how many frames came between us and the match
+float flashdifference(float threshold, int *length) {
+  int n = thumbw * thumbh;
+  float best = 100.0;
+  *length = 0;
+  for(int k = 2; k <= ringcount; k++) {
+    float *then = ring + ((ringhead - k + ringsize) % ringsize) * n;
+    float lanes[LANES] = { 0.0 };
+    int i = 0;
+    for(; i + LANES <= n; i += LANES) {
+      for(int j = 0; j < LANES; j++) {
+        lanes[j] += fabsf(thumb[i + j] - then[i + j]);
+      }
+    }
+    for(int j = 0; i + j < n; j++) {
+      lanes[j] += fabsf(thumb[i + j] - then[i + j]);
+    }
+    float total = 0.0;
+    for(int j = 0; j < LANES; j++) {
+      total += lanes[j];
+    }
+    float difference = 100.0 * total / activesamples;
+    if(difference < best) {
+      best = difference;
+      *length = k - 1;
+    }
+    if(difference <= threshold) break;
+  }
+  return best;
+}
+
+// Add this frame's luma thumbnail to the history ring
+void ringpush(void) {
+  int n = thumbw * thumbh;
+  memcpy(ring + ringhead * n, thumb, n * sizeof(float));
+  ringhead = (ringhead + 1) % ringsize;
+  if(ringcount < ringsize) ringcount++;
+}
+
+// Sum of absolute differences between a block of this frame's thumbnail
+// and the previous frame's thumbnail shifted by dx, dy.  We accumulate
+// each column separately so the inner loop vectorises, and give up early
+// once we're already worse than the best match so far
+float blocksad(int bx, int by, int bw, int bh, int dx, int dy, float best) {
+  float columns[MOTIONBLOCK] = { 0.0 };
+  float sad = 0.0;
+  for(int y = 0; y < bh; y++) {
+    float *cur = thumb + (by + y) * thumbw + bx;
+    float *prev = prevthumb + (by + y + dy) * thumbw + bx + dx;
+    for(int x = 0; x < bw; x++) {
+      columns[x] += fabsf(cur[x] - prev[x]);
+    }
+    sad = 0.0;
+    for(int x = 0; x < bw; x++) {
+      sad += columns[x];
+    }
+    if(sad >= best) break;
+  }
+  return sad;
+}
+
+// Split the thumbnail into blocks, find where each one best matches the
+// previous frame within radius samples, and average what's left over.  A
+// pan moves the blocks but they still match, a cut doesn't match anywhere
+float motiondifference(int radius) {
+  float totalresidual = 0.0;
+  for(int by = 0; by < thumbh; by += MOTIONBLOCK) {
+    int bh = thumbh - by < MOTIONBLOCK ? thumbh - by : MOTIONBLOCK;
+    for(int bx = 0; bx < thumbw; bx += MOTIONBLOCK) {
+      int bw = thumbw - bx < MOTIONBLOCK ? thumbw - bx : MOTIONBLOCK;
+
+      // Start with no motion so static blocks bail out quickly
+      float best = blocksad(bx, by, bw, bh, 0, 0, INFINITY);
+      for(int dy = -radius; dy <= radius && best > 0.0; dy++) {
+        if(by + dy < 0 || by + dy + bh > thumbh) continue;
+        for(int dx = -radius; dx <= radius; dx++) {
+          if(bx + dx < 0 || bx + dx + bw > thumbw) continue;
+          if(dx == 0 && dy == 0) continue;
+          float sad = blocksad(bx, by, bw, bh, dx, dy, best);
+          if(sad < best) best = sad;
+        }
+      }
+      totalresidual += best;
+    }
+  }
+  return 100.0 * totalresidual / activesamples;
+}
+
+// Add n to the count in a rolling window bin
+void rolladd(int bin, int n) {
+  for(int i = bin + 1; i <= ROLLBINS; i += i & -i) {
+    rolltree[i] += n;
+  }
+}
+
+// Number of values in the rolling window in bins 0 to bin inclusive
+int rollprefix(int bin) {
+  if(bin < 0) return 0;
+  if(bin >= ROLLBINS) bin = ROLLBINS - 1;
+  int n = 0;
+  for(int i = bin + 1; i > 0; i -= i & -i) {
+    n += rolltree[i];
+  }
+  return n;
+}
+
+// Bin holding the k'th smallest value in the rolling window, k from 1
+int rollkth(int k) {
+  int pos = 0;
+  for(int step = ROLLBINS; step > 0; step >>= 1) {
+    if(pos + step <= ROLLBINS && rolltree[pos + step] < k) {
+      pos += step;
+      k -= rolltree[pos];
+    }
+  }
+  return pos;
+}
+
+// Push a difference into the rolling window, dropping the oldest once
+// it holds window values
+void rollpush(float difference, int window) {
+  int bin = difference * ROLLSCALE;
+  if(bin < 0) bin = 0;
+  if(bin >= ROLLBINS) bin = ROLLBINS - 1;
+  int slot = rollframes % window;
+  if(rollcount == window) {
+    rolladd(rollring[slot], -1);
+  } else {
+    rollcount++;
+  }
+  rollring[slot] = bin;
+  rolladd(bin, 1);
+  rollframes++;
+}
+
+// Median and median absolute deviation of the rolling window.  The MAD is
+// the smallest distance either side of the median which holds half the
+// values, which we can binary search for with two prefix counts per step
+void rollstats(float *median, float *mad) {
+  int half = (rollcount + 1) / 2;
+  int m = rollkth(half);
+  int lo = 0, hi = ROLLBINS;
+  while(lo < hi) {
+    int d = (lo + hi) / 2;
+    if(rollprefix(m + d) - rollprefix(m - d - 1) >= half) {
+      hi = d;
+    } else {
+      lo = d + 1;
+    }
+  }
+  *median = m / ROLLSCALE;
+  *mad = lo / ROLLSCALE;
+}
+
+// Forget everything in the rolling window
+void rollreset(void) {
+  memset(rolltree, 0, sizeof(rolltree));
+  rollcount = 0;
+  rollframes = 0;
+}
+
+// For qsort()
+int comparefloats(const void *a, const void *b) {
+  float fa = *(const float *)a, fb = *(const float *)b;
+  return (fa > fb) - (fa < fb);
+}
+
+// Number of sorted differences less than v, or less than or equal to v
+// if orequal is set
+int countbelow(float v, int orequal) {
+  int lo = 0, hi = nsorted;
+  while(lo < hi) {
+    int mid = (lo + hi) / 2;
+    if(sorteddiffs[mid] < v || (orequal && sorteddiffs[mid] == v)) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+// Sort every frame's difference on the picked metric once, then key a
+// curve saying how many cuts there'd be if the cut threshold were set just
+// under each frame's difference.  That's before flashes and dissolves are
+// taken into account
+void sortdifferences(int frames) {
+  free(sorteddiffs);
+  nsorted = frames > 1 ? frames - 1 : 0;
+  sorteddiffs = (float *) malloc((nsorted + 1) * sizeof(float));
+  for(int i = 1; i < frames; i++) {
+    sorteddiffs[i - 1] = sparkGetCurveValuef(SPARK_UI_CONTROL, metriccontrols[SparkPup20.Value], i);
+  }
+  qsort(sorteddiffs, nsorted, sizeof(float), comparefloats);
+  for(int i = 1; i < frames; i++) {
+    float difference = sparkGetCurveValuef(SPARK_UI_CONTROL, metriccontrols[SparkPup20.Value], i);
+    sparkSetCurveKey(SPARK_UI_CONTROL, 33, i, nsorted - countbelow(difference, 0));
+  }
+  sparkControlUpdate(33);
+}
+
+// Flame asks us what extra image buffers we'll want here, we register 1
+void SparkMemoryTempBuffers(void) {
+    prevframeid = sparkMemRegisterBuffer();
+}
+
+// Spark entry function
+unsigned int SparkInitialise(SparkInfoStruct si) {
+  return(SPARK_MODULE);
+}
+
+// Copy the pixel at block over the next n - 1.  Fixed sizes let the
+// compiler do each copy as a move or two rather than a call
+void heatfill(char *block, int bytes, int n) {
+  if(bytes == 3) {
+    for(int i = 1; i < n; i++) memcpy(block + 3 * i, block, 3);
+  } else if(bytes == 6) {
+    for(int i = 1; i < n; i++) memcpy(block + 6 * i, block, 6);
+  } else {
+    for(int i = 1; i < n; i++) memcpy(block + bytes * i, block, bytes);
+  }
+}
+
+// Draw a heat-map of frame's difference to the previous frame into result.
+// Thumbnails are made and compared just as the analysis makes and compares
+// them, inside the region it found, so the map shows exactly what the
+// curve measured.  Each sample fills its downres x downres block, black
+// through red and yellow to white, and anything outside the region is
+// black.  The analysis' thumbnail layout is borrowed and put back after
+int heatmap(SparkMemBufStruct *result, SparkMemBufStruct *front, int frame, int downres, float gain) {
+  int savew = thumbw, saveh = thumbh, savex = roix, savey = roiy;
+  unsigned char *savemask = roimask;
+  if(heatroiw > 0 && heatframew == front->BufWidth && heatframeh == front->BufHeight && heatdownres == downres) {
+    roix = heatroix;
+    roiy = heatroiy;
+    thumbw = heatroiw;
+    thumbh = heatroih;
+    roimask = heatmask;
+  } else {
+    roix = roiy = 0;
+    thumbw = (front->BufWidth - 1) / downres;
+    thumbh = (front->BufHeight - 1) / downres;
+    roimask = NULL;
+  }
+  int n = thumbw * thumbh;
+  if(n > heatsize) {
+    free(heatthumb);
+    free(heatprev);
+    free(heatsamples);
+    heatthumb = (float *) malloc(3 * n * sizeof(float));
+    heatprev = (float *) malloc(3 * n * sizeof(float));
+    heatsamples = (float *) malloc(n * sizeof(float));
+    heatsize = n;
+    heatframe = -1;
+  }
+  int rowbytes = result->BufWidth * result->Inc;
+  if(rowbytes > heatrowbytes) {
+    free(heatrow);
+    heatrow = (char *) malloc(rowbytes);
+    heatrowbytes = rowbytes;
+  }
+
+  // Thumbnail of the frame before, unless it's the one we drew last
+  int h[HISTBINS];
+  int key[8] = { front->BufWidth, front->BufHeight, front->BufDepth, downres, SparkSetupInt21.Value, roix, roiy, n };
+  if(heatframe != frame - 1 || memcmp(key, heatkey, sizeof(key))) {
+    SparkMemBufStruct prev;
+    if(!bufferReady(prevframeid, &prev)) {
+      thumbw = savew;
+      thumbh = saveh;
+      roix = savex;
+      roiy = savey;
+      roimask = savemask;
+      return 0;
+    }
+    sparkGetFrame(SPARK_FRONT_CLIP, frame - 1, prev.Buffer);
+    makethumb(&prev, downres, heatprev, h);
+  }
+  makethumb(front, downres, heatthumb, h);
+  float luma, chroma;
+  int changed;
+  thumbdifferences(heatthumb, heatprev, 0.0, &luma, &chroma, &changed, heatsamples);
+  float *t = heatprev;
+  heatprev = heatthumb;
+  heatthumb = t;
+  heatframe = frame;
+  memcpy(heatkey, key, sizeof(key));
+
+  // Each row of blocks is made once, then copied down the block
+  int bytes = result->Inc;
+  int left = roix * downres;
+  for(int y = 0; y < result->BufHeight; y++) {
+    char *out = (char *)(result->Buffer) + y * result->Stride;
+    int ty = y / downres - roiy;
+    if(ty < 0 || ty >= thumbh) {
+      memset(out, 0, rowbytes);
+      continue;
+    }
+    if(y % downres == 0) {
+      memset(heatrow, 0, rowbytes);
+      for(int tx = 0; tx < thumbw; tx++) {
+        float heat = 3.0 * gain * heatsamples[ty * thumbw + tx];
+        if(heat > 3.0) heat = 3.0;
+        char *block = heatrow + (left + tx * downres) * bytes;
+        writepixel(block, result->BufDepth, heat > 1.0 ? 1.0 : heat, heat < 1.0 ? 0.0 : heat > 2.0 ? 1.0 : heat - 1.0, heat < 2.0 ? 0.0 : heat - 2.0);
+        heatfill(block, bytes, downres);
+      }
+    }
+    memcpy(out, heatrow, rowbytes);
+  }
+
+  thumbw = savew;
+  thumbh = saveh;
+  roix = savex;
+  roiy = savey;
+  roimask = savemask;
+  return 1;
+}
+
+// Spark entry point for each frame to be rendered
+unsigned long *SparkProcess(SparkInfoStruct si) {
+  // Check Spark image buffers are ready for use
+  SparkMemBufStruct result, front;
+  if(!bufferReady(2, &front)) return(NULL);
+
+  // Normally we just pass the front clip through untouched, no need to
+  // copy it into the result buffer first
+  if(SparkBoolean9.Value == 0) {
+    return(front.Buffer);
+  }
+
+  if(!bufferReady(1, &result)) return(NULL);
+  float gain = sparkGetCurveValuef(SPARK_UI_CONTROL, 10, si.FrameNo + 1);
+  if(!heatmap(&result, &front, si.FrameNo, SparkSetupInt15.Value, gain)) return(NULL);
+
+  return(result.Buffer);
+}
+
+// The cut threshold at frame that the EDL goes by, adaptive or fixed
+float cutthresholdat(int frame) {
+  return sparkGetCurveValuef(SPARK_UI_CONTROL, SparkBoolean17.Value ? 18 : 22, frame);
+}
+
+// How close, as a luma difference, the picture after a flash has to come
+// back to the one before it.  The flash history is always compared on
+// luma, whatever metric the cuts are found on, so this can't be the cut
+// threshold.  It wants to be under the luma cut threshold, or a cut to a
+// similar looking shot can pass for a flash
+float flashthresholdat(int frame) {
+  return sparkGetCurveValuef(SPARK_UI_CONTROL, 43, frame);
+}
+
+// Find the closest match to this frame's thumbnail further back than the
+// previous frame, and key it at frame
+void flashframe(int frame) {
+  int flashlength;
+  float flashthreshold = flashthresholdat(frame);
+  float flashdiff = flashdifference(flashthreshold, &flashlength);
+  SparkFloat6.Value = flashdiff;
+  sparkSetCurveKey(SPARK_UI_CONTROL, 6, frame, flashdiff);
+  sparkControlUpdate(6);
+  SparkFloat7.Value = flashlength;
+  sparkSetCurveKey(SPARK_UI_CONTROL, 7, frame, flashlength);
+  sparkControlUpdate(7);
+}
+
+// Work out every metric for this frame's thumbnail against the previous
+// frame's, and key them on their curves at frame
+void scoreframe(int frame) {
+  // Loop through samples, find difference to same sample
+  // in previous frame, and sum up the differences
+  float totaldifference, totalchroma;
+  int changed;
+  float tolerance = sparkGetCurveValuef(SPARK_UI_CONTROL, 31, frame) / 100.0;
+  thumbdifferences(thumb, prevthumb, tolerance, &totaldifference, &totalchroma, &changed, NULL);
+
+  // Set difference key for this frame.  Without a region of interest
+  // this is scaled as it always has been so old thresholds still work
+  float avgdifference = 100.0 * totaldifference / lumasamples;
+  if(SparkSetupInt19.Value > 0) {
+    avgdifference = 100.0 * totaldifference / activesamples;
+  }
+	SparkFloat21.Value = avgdifference;
+	sparkSetCurveKey(SPARK_UI_CONTROL, 21, frame, avgdifference);
+	sparkControlUpdate(21);
+
+  // Chroma difference and fraction of samples that changed
+  float chromadiff = 100.0 * totalchroma / activesamples;
+  SparkFloat29.Value = chromadiff;
+  sparkSetCurveKey(SPARK_UI_CONTROL, 29, frame, chromadiff);
+  sparkControlUpdate(29);
+  float changedratio = 100.0 * changed / activesamples;
+  SparkFloat30.Value = changedratio;
+  sparkSetCurveKey(SPARK_UI_CONTROL, 30, frame, changedratio);
+  sparkControlUpdate(30);
+
+  // Motion-compensated difference.  With no search radius it's just the
+  // plain difference, block by block, so the Metric menu still works
+  float motiondiff = motiondifference(SparkSetupInt16.Value);
+  SparkFloat27.Value = motiondiff;
+  sparkSetCurveKey(SPARK_UI_CONTROL, 27, frame, motiondiff);
+  sparkControlUpdate(27);
+
+  // Histogram distance
+  float histdiff = histdistance(hist, prevhist);
+  SparkFloat28.Value = histdiff;
+  sparkSetCurveKey(SPARK_UI_CONTROL, 28, frame, histdiff);
+  sparkControlUpdate(28);
+
+  // Difference with flicker and exposure changes taken out
+  float gaindiff = gaindifference();
+  SparkFloat40.Value = gaindiff;
+  sparkSetCurveKey(SPARK_UI_CONTROL, 40, frame, gaindiff);
+  sparkControlUpdate(40);
+
+  // Edge change ratio
+  float edgediff = edgechange();
+  SparkFloat41.Value = edgediff;
+  sparkSetCurveKey(SPARK_UI_CONTROL, 41, frame, edgediff);
+  sparkControlUpdate(41);
+
+  // Average brightness, for the shot table.  Masked samples are black
+  float lumasum = 0.0;
+  for(int i = 0; i < thumbw * thumbh; i++) {
+    lumasum += thumb[i];
+  }
+  float meanluma = 100.0 * lumasum / activesamples;
+  SparkFloat38.Value = meanluma;
+  sparkSetCurveKey(SPARK_UI_CONTROL, 38, frame, meanluma);
+  sparkControlUpdate(38);
+
+  flashframe(frame);
+}
+
+// Adaptive thresholds at frame from the frames before it, on whichever
+// metric is picked.  Until we've seen a few frames there's nothing to go
+// on, so use the fixed thresholds.  They don't need frame itself scored
+void adaptiveframe(int frame) {
+  float adaptivecut = sparkGetCurveValuef(SPARK_UI_CONTROL, 22, frame);
+  float adaptivedup = sparkGetCurveValuef(SPARK_UI_CONTROL, 23, frame);
+  if(rollcount >= 3) {
+    // A static shot can have almost no spread at all, so don't let the
+    // spread estimate fall below a tenth of the median, and don't let the
+    // cut threshold fall below half the fixed one or every flicker in a
+    // locked-off shot would be a cut.  Dupes only ever get easier to find
+    // in busy footage, where a tenth of the median is still nearly still
+    float median, mad;
+    rollstats(&median, &mad);
+    float spread = 1.4826 * mad;
+    if(spread < 0.1 * median) spread = 0.1 * median;
+    float sensitivity = sparkGetCurveValuef(SPARK_UI_CONTROL, 24, frame);
+    if(median + sensitivity * spread > 0.5 * adaptivecut) {
+      adaptivecut = median + sensitivity * spread;
+    } else {
+      adaptivecut = 0.5 * adaptivecut;
+    }
+    if(0.1 * median > adaptivedup) {
+      adaptivedup = 0.1 * median;
+    }
+  }
+  SparkFloat18.Value = adaptivecut;
+  sparkSetCurveKey(SPARK_UI_CONTROL, 18, frame, adaptivecut);
+  sparkControlUpdate(18);
+  SparkFloat19.Value = adaptivedup;
+  sparkSetCurveKey(SPARK_UI_CONTROL, 19, frame, adaptivedup);
+  sparkControlUpdate(19);
+}
+
+// Add frame's difference to the rolling window, once it's been scored
+void adaptivepush(int frame) {
+  float difference = sparkGetCurveValuef(SPARK_UI_CONTROL, metriccontrols[SparkPup20.Value], frame);
+  rollpush(difference, SparkSetupInt17.Value);
+}
+
+// Work out the adaptive thresholds for frames 1 to frames again from the
+// difference curves, just as analysing them in order would have
+void adaptivecurves(int frames) {
+  rollreset();
+  for(int f = 1; f <= frames; f++) {
+    adaptiveframe(f);
+    adaptivepush(f);
+  }
+  rollreset();
+}
+
+// Hash of a thumbnail, which is how we tell whether a frame has changed
+// since it was checkpointed.  FNV-1a, a word at a time
+unsigned long long thumbsignature(float *t) {
+  unsigned int *w = (unsigned int *) t;
+  unsigned long long h = 14695981039346656037ULL;
+  for(int i = 0; i < 3 * thumbw * thumbh; i++) {
+    h = (h ^ w[i]) * 1099511628211ULL;
+  }
+  return h;
+}
+
+// Open the checkpoint named in the UI.  If it was made from a clip of the
+// same size with the same setup we read what's in it, otherwise we start
+// a new one
+void checkopen(SparkInfoStruct si, SparkMemBufStruct *front) {
+  checkmatched = checkreused = checkscored = 0;
+  if(SparkBoolean35.Value == 0) return;
+  if(SparkSetupInt19.Value > 0) {
+    printf("CutDetective: Can't checkpoint while finding letterbox, not checkpointing\n");
+    return;
+  }
+
+	// Sometimes strings from UI controls come back with a line break
+  char *path = strdup(SparkString36.Value);
+	int pathlen = strlen(path);
+	if(pathlen > 0 && path[pathlen - 1] == '\n') {
+		path[pathlen - 1] = '\0';
+	}
+
+  CheckHeader want, got;
+  memset(&want, 0, sizeof(want));
+  memcpy(want.magic, CHECKMAGIC, 8);
+  want.width = front->BufWidth;
+  want.height = front->BufHeight;
+  want.depth = front->BufDepth;
+  want.downres = SparkSetupInt15.Value;
+  want.radius = SparkSetupInt16.Value;
+  want.history = SparkSetupInt20.Value;
+  want.box = SparkSetupInt21.Value;
+  want.frames = si.TotalFrameNo;
+  checkframes = si.TotalFrameNo;
+  checkrecords = (CheckRecord *) calloc(checkframes + 1, sizeof(CheckRecord));
+  checkfd = fopen(path, "r+b");
+  if(checkfd != NULL && fread(&got, sizeof(got), 1, checkfd) == 1 && !memcmp(&got, &want, sizeof(want))) {
+    int n = fread(checkrecords + 1, sizeof(CheckRecord), checkframes, checkfd);
+    printf("CutDetective: Checkpoint %s has %d frames\n", path, n);
+  } else {
+    if(checkfd != NULL) fclose(checkfd);
+    checkfd = fopen(path, "w+b");
+    if(checkfd == NULL) {
+      printf("CutDetective: Failed to open %s for writing\n", path);
+      free(checkrecords);
+      checkrecords = NULL;
+    } else {
+      fwrite(&want, sizeof(want), 1, checkfd);
+    }
+  }
+  free(path);
+}
+
+// Note whether the thumbnail t of frame is the one in the checkpoint.
+// checkmatched counts how many frames in a row have been
+void checkmatch(int frame, float *t) {
+  if(checkfd == NULL) return;
+  CheckRecord *r = &checkrecords[frame];
+  if(r->valid && r->signature == thumbsignature(t)) {
+    checkmatched++;
+  } else {
+    checkmatched = 0;
+  }
+}
+
+// Key a metric from the checkpoint
+void checkkey(SparkFloatStruct *control, int id, int frame, float value) {
+  control->Value = value;
+  sparkSetCurveKey(SPARK_UI_CONTROL, id, frame, value);
+  sparkControlUpdate(id);
+}
+
+// Score this frame, unless the checkpoint says we already did with the
+// same settings.  The frame and everything in the flash history before it
+// must be unchanged, and the history must have been just as full
+void checkscore(int frame) {
+  if(checkfd == NULL) {
+    scoreframe(frame);
+    return;
+  }
+  checkmatch(frame, thumb);
+  CheckRecord *r = &checkrecords[frame];
+  float tolerance = sparkGetCurveValuef(SPARK_UI_CONTROL, 31, frame);
+  float flashthreshold = flashthresholdat(frame);
+  if(checkmatched > ringcount && r->ringcount == ringcount && r->tolerance == tolerance && r->flashthreshold == flashthreshold) {
+    checkkey(&SparkFloat21, 21, frame, r->difference);
+    checkkey(&SparkFloat27, 27, frame, r->motion);
+    checkkey(&SparkFloat28, 28, frame, r->histogram);
+    checkkey(&SparkFloat29, 29, frame, r->chroma);
+    checkkey(&SparkFloat30, 30, frame, r->changed);
+    checkkey(&SparkFloat6, 6, frame, r->flash);
+    checkkey(&SparkFloat7, 7, frame, r->flashlength);
+    checkkey(&SparkFloat38, 38, frame, r->luma);
+    checkkey(&SparkFloat40, 40, frame, r->gain);
+    checkkey(&SparkFloat41, 41, frame, r->edges);
+    checkreused++;
+    return;
+  }
+
+  scoreframe(frame);
+  r->signature = thumbsignature(thumb);
+  r->tolerance = tolerance;
+  r->flashthreshold = flashthreshold;
+  r->ringcount = ringcount;
+  r->valid = 1;
+  r->difference = SparkFloat21.Value;
+  r->motion = SparkFloat27.Value;
+  r->histogram = SparkFloat28.Value;
+  r->chroma = SparkFloat29.Value;
+  r->changed = SparkFloat30.Value;
+  r->flash = SparkFloat6.Value;
+  r->flashlength = SparkFloat7.Value;
+  r->luma = SparkFloat38.Value;
+  r->gain = SparkFloat40.Value;
+  r->edges = SparkFloat41.Value;
+  fseek(checkfd, sizeof(CheckHeader) + (frame - 1) * sizeof(CheckRecord), SEEK_SET);
+  fwrite(r, sizeof(CheckRecord), 1, checkfd);
+  if(++checkscored % CHECKEVERY == 0) {
+    fflush(checkfd);
+  }
+}
+
+// Finish off the checkpoint and say how much it saved
+void checkclose(void) {
+  if(checkfd == NULL) return;
+  fclose(checkfd);
+  checkfd = NULL;
+  free(checkrecords);
+  checkrecords = NULL;
+  printf("CutDetective: Reused %d frames from checkpoint, scored %d\n", checkreused, checkscored);
+}
+
+// Seconds since the epoch
+double telemetrynow(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+// Make the shared memory segment we publish progress in
+void telemetryopen(void) {
+  telemetryframes = telemetrycuts = 0;
+  telemetrystart = telemetrynow();
+  if(SparkBoolean37.Value == 0) return;
+  sprintf(telemetryname, "%s%d", TELEMETRYPREFIX, (int) getpid());
+  int fd = shm_open(telemetryname, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if(fd < 0 || ftruncate(fd, sizeof(TelemetrySegment)) != 0) {
+    printf("CutDetective: Failed to make shared memory %s for progress\n", telemetryname);
+    if(fd >= 0) close(fd);
+    return;
+  }
+  void *m = mmap(NULL, sizeof(TelemetrySegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if(m == MAP_FAILED) {
+    printf("CutDetective: Failed to map shared memory %s for progress\n", telemetryname);
+    shm_unlink(telemetryname);
+    return;
+  }
+  telemetry = (TelemetrySegment *) m;
+  telemetry->pid = getpid();
+  int edllen = strcspn(SparkString11.Value, "\n");
+  if(edllen > (int) sizeof(telemetry->edl) - 1) edllen = sizeof(telemetry->edl) - 1;
+  memcpy(telemetry->edl, SparkString11.Value, edllen);
+  memcpy(telemetry->magic, TELEMETRYMAGIC, 8);
+}
+
+// Publish how we're getting on after analysing frame.  Never waits for
+// anything, readers just have to keep up
+void telemetrypublish(int frame, int total) {
+  float difference = sparkGetCurveValuef(SPARK_UI_CONTROL, metriccontrols[SparkPup20.Value], frame);
+  float cutthreshold = cutthresholdat(frame);
+  telemetryframes++;
+  if(difference > cutthreshold) telemetrycuts++;
+  if(telemetry == NULL) return;
+  unsigned long long written = telemetry->written;
+  TelemetryRecord *r = &telemetry->ring[written % TELEMETRYSLOTS];
+  r->frame = frame;
+  r->total = total;
+  r->analysed = telemetryframes;
+  r->cuts = telemetrycuts;
+  r->difference = difference;
+  r->updated = telemetrynow();
+  r->fps = telemetryframes / (r->updated - telemetrystart + 1e-6);
+  __atomic_store_n(&telemetry->written, written + 1, __ATOMIC_RELEASE);
+}
+
+// Say we're done and take the segment away.  Anyone who has it mapped
+// can still see the last update
+void telemetryclose(void) {
+  if(telemetry == NULL) return;
+  __atomic_store_n(&telemetry->finished, 1, __ATOMIC_RELEASE);
+  munmap(telemetry, sizeof(TelemetrySegment));
+  shm_unlink(telemetryname);
+  telemetry = NULL;
+}
+
+// A frame scorepairs needs, its thumbnail while some pair still needs it,
+// and how many pairs that is
+typedef struct {
+  int frame;
+  int pending;
+  float *thumb;
+  int hist[HISTBINS];
+} PairFrame;
+
+// Order pairs by the later frame in them, then the earlier
+int comparepairorder(const void *a, const void *b) {
+  FramePair *pa = *(FramePair **) a, *pb = *(FramePair **) b;
+  int la = pa->a > pa->b ? pa->a : pa->b, lb = pb->a > pb->b ? pb->a : pb->b;
+  if(la != lb) return la - lb;
+  return (pa->a < pa->b ? pa->a : pa->b) - (pb->a < pb->b ? pb->a : pb->b);
+}
+
+int compareints(const void *a, const void *b) {
+  return *(int *) a - *(int *) b;
+}
+
+// Where frame is in the sorted list of frames we need
+PairFrame *pairframe(PairFrame *frames, int nframes, int frame) {
+  int lo = 0, hi = nframes - 1;
+  while(lo < hi) {
+    int mid = (lo + hi) / 2;
+    if(frames[mid].frame < frame) lo = mid + 1;
+    else hi = mid;
+  }
+  return &frames[lo];
+}
+
+// Score arbitrary pairs of frames, as if b came straight after a, without
+// analysing anything in between.  For checking suspected cuts on a long
+// clip, where the pairs are each cut and the frame before it.  We go
+// through the frames in order reading each one once, however many pairs
+// it's in, and keep its thumbnail only until the last of those is scored.
+// Results go in the pairs rather than on the curves, and there's no flash
+// history or region of interest.  Returns how many frames were read, or
+// -1 if something failed
+int scorepairs(FramePair *pairs, int npairs) {
+  if(haveprev) {
+    printf("CutDetective: Can't score frame pairs while analysing\n");
+    return -1;
+  }
+  SparkMemBufStruct buf;
+  if(!bufferReady(prevframeid, &buf)) {
+    printf("CutDetective: prev buffer not ready for scoring pairs!\n");
+    return -1;
+  }
+  int downres = SparkSetupInt15.Value;
+  thumbw = (buf.BufWidth - 1) / downres;
+  thumbh = (buf.BufHeight - 1) / downres;
+  roix = roiy = 0;
+  roimask = NULL;
+  activesamples = thumbw * thumbh;
+  lumasamples = (buf.BufWidth / downres) * (buf.BufHeight / downres);
+  int n = thumbw * thumbh;
+  edgealloc();
+
+  // Every frame we need once, in order, with how many pairs need it
+  int *wanted = (int *) malloc(2 * npairs * sizeof(int));
+  for(int i = 0; i < npairs; i++) {
+    wanted[2 * i] = pairs[i].a;
+    wanted[2 * i + 1] = pairs[i].b;
+  }
+  qsort(wanted, 2 * npairs, sizeof(int), compareints);
+  PairFrame *frames = (PairFrame *) calloc(2 * npairs, sizeof(PairFrame));
+  int nframes = 0;
+  for(int i = 0; i < 2 * npairs; i++) {
+    if(nframes == 0 || frames[nframes - 1].frame != wanted[i]) {
+      frames[nframes++].frame = wanted[i];
+    }
+  }
+  free(wanted);
+  for(int i = 0; i < npairs; i++) {
+    pairframe(frames, nframes, pairs[i].a)->pending++;
+    if(pairs[i].b != pairs[i].a) pairframe(frames, nframes, pairs[i].b)->pending++;
+  }
+  FramePair **pairorder = (FramePair **) malloc(npairs * sizeof(FramePair *));
+  for(int i = 0; i < npairs; i++) {
+    pairorder[i] = &pairs[i];
+  }
+  qsort(pairorder, npairs, sizeof(FramePair *), comparepairorder);
+
+  int reads = 0, next = 0;
+  for(int i = 0; i < nframes; i++) {
+    PairFrame *f = &frames[i];
+    if(!sparkGetFrame(SPARK_FRONT_CLIP, f->frame, buf.Buffer)) {
+      printf("CutDetective: Failed to read frame %d\n", f->frame);
+      reads = -1;
+      break;
+    }
+    reads++;
+    f->thumb = (float *) malloc(3 * n * sizeof(float));
+    makethumb(&buf, downres, f->thumb, f->hist);
+
+    // Every pair whose later frame this is has both thumbnails now
+    for(; next < npairs; next++) {
+      FramePair *p = pairorder[next];
+      if((p->a > p->b ? p->a : p->b) != f->frame) break;
+      PairFrame *fa = pairframe(frames, nframes, p->a);
+      PairFrame *fb = pairframe(frames, nframes, p->b);
+      prevthumb = fa->thumb;
+      thumb = fb->thumb;
+      memcpy(prevhist, fa->hist, sizeof(prevhist));
+      memcpy(hist, fb->hist, sizeof(hist));
+      float luma, chroma;
+      int changed;
+      float tolerance = sparkGetCurveValuef(SPARK_UI_CONTROL, 31, p->b + 1) / 100.0;
+      thumbdifferences(thumb, prevthumb, tolerance, &luma, &chroma, &changed, NULL);
+      p->luma = 100.0 * luma / lumasamples;
+      p->chroma = 100.0 * chroma / activesamples;
+      p->changed = 100.0 * changed / activesamples;
+      p->motion = motiondifference(SparkSetupInt16.Value);
+      p->histogram = histdistance(hist, prevhist);
+      p->gain = gaindifference();
+      edgemap(prevthumb, prevedges);
+      edgemap(thumb, edges);
+      p->edges = edgechange();
+      if(--fa->pending == 0) {
+        free(fa->thumb);
+        fa->thumb = NULL;
+      }
+      if(fb != fa && --fb->pending == 0) {
+        free(fb->thumb);
+        fb->thumb = NULL;
+      }
+    }
+  }
+  for(int i = 0; i < nframes; i++) {
+    free(frames[i].thumb);
+  }
+  free(frames);
+  free(pairorder);
+  edgefree();
+  boxfree();
+  thumb = prevthumb = NULL;
+  return reads;
+}
+
+// Spark entry point for each frame analysed
+unsigned long *SparkAnalyse(SparkInfoStruct si) {
+  // Check Spark image buffers are ready for use
+  SparkMemBufStruct result, front, prev;
+  if(!bufferReady(1, &result)) {
+    printf("CutDetective: result buffer not ready at frame %d!\n", si.FrameNo);
+    return(NULL);
+  }
+  if(!bufferReady(2, &front)) {
+    printf("CutDetective: front buffer not ready at frame %d!\n", si.FrameNo);
+    return(NULL);
+  }
+
+  int downres = SparkSetupInt15.Value;
+	if(haveprev == 0) {
+		// If this is the first frame of the analysis, we won't
+		// have a previous frame thumbnail stored yet, so fetch it
+    if(!bufferReady(prevframeid, &prev)) {
+      printf("CutDetective: prev buffer not ready at frame %d!\n", si.FrameNo);
+      return(NULL);
+    }
+	  sparkGetFrame(SPARK_FRONT_CLIP, si.FrameNo - 1, prev.Buffer);
+    thumbw = (front.BufWidth - 1) / downres;
+    thumbh = (front.BufHeight - 1) / downres;
+    heatframew = front.BufWidth;
+    heatframeh = front.BufHeight;
+    roix = roiy = 0;
+    roiseen = 0;
+    roimask = NULL;
+    activesamples = thumbw * thumbh;
+    lumasamples = (front.BufWidth / downres) * (front.BufHeight / downres);
+    if(SparkSetupInt19.Value > 0) {
+      roimax = (float *) calloc(thumbw * thumbh, sizeof(float));
+      roichurn = (int *) calloc(thumbw * thumbh, sizeof(int));
+    }
+    prevthumb = (float *) malloc(3 * thumbw * thumbh * sizeof(float));
+    thumb = (float *) malloc(3 * thumbw * thumbh * sizeof(float));
+    makethumb(&prev, downres, prevthumb, prevhist);
+    edgealloc();
+    edgemap(prevthumb, prevedges);
+    tilefirst = si.FrameNo - 1;
+    if(SparkBoolean42.Value == 1 && roimax == NULL) {
+      tilestart(si.TotalFrameNo);
+      tilekeep(si.FrameNo - 1, prevthumb);
+    }
+    if(SparkBoolean12.Value == 1) {
+      streamstart(si.TotalFrameNo);
+    }
+    ringsize = SparkSetupInt20.Value + 1;
+    ring = (float *) malloc(ringsize * thumbw * thumbh * sizeof(float));
+    ringhead = ringcount = 0;
+    memcpy(ring, prevthumb, thumbw * thumbh * sizeof(float));
+    ringhead = ringcount = 1;
+    checkopen(si, &front);
+    checkmatch(si.FrameNo > 0 ? si.FrameNo : 1, prevthumb);
+    telemetryopen();
+    haveprev = 1;
+	}
+  makethumb(&front, downres, thumb, hist);
+  edgemap(thumb, edges);
+  if(SparkBoolean42.Value == 1 && roimax == NULL) {
+    tilekeep(si.FrameNo, thumb);
+  }
+
+  adaptiveframe(si.FrameNo + 1);
+  checkscore(si.FrameNo + 1);
+  adaptivepush(si.FrameNo + 1);
+
+  if(roimax != NULL) {
+    roilearn(sparkGetCurveValuef(SPARK_UI_CONTROL, 31, si.FrameNo + 1) / 100.0);
+  }
+
+  // Write out any EDL events we're now sure of
+  if(streaming) {
+    streamto(si.FrameNo + 1, si.TotalFrameNo);
+  }
+  telemetrypublish(si.FrameNo + 1, si.TotalFrameNo);
+
+	// Keep this frame's thumbnail and histograms for next frame
+  ringpush();
+  float *t = prevthumb;
+  prevthumb = thumb;
+  thumb = t;
+  memcpy(prevhist, hist, sizeof(hist));
+  unsigned long long *e = prevedges;
+  prevedges = edges;
+  edges = e;
+
+  // Once we've seen enough frames, shrink to the region of interest
+  if(roimax != NULL && roiseen >= SparkSetupInt19.Value) {
+    roifinish();
+
+    // Older frames in the history are the wrong shape now, as are the
+    // edge maps
+    memcpy(ring, prevthumb, thumbw * thumbh * sizeof(float));
+    ringhead = ringcount = 1;
+    edgealloc();
+    edgemap(prevthumb, prevedges);
+    if(SparkBoolean42.Value == 1) {
+      tilestart(si.TotalFrameNo);
+      tilecatchup(tilefirst, si.FrameNo, downres);
+    }
+  }
+
+  return(front.Buffer);
+}
+
+// Called when Analyse pass finished
+void SparkAnalyseEnd(SparkInfoStruct si) {
+  printf("Analyse end at frame %d\n", si.FrameNo);
+
+  // The heat-map carries on using the region we found
+  if(haveprev) {
+    free(heatmask);
+    heatmask = roimask;
+    heatroix = roix;
+    heatroiy = roiy;
+    heatroiw = thumbw;
+    heatroih = thumbh;
+    heatdownres = SparkSetupInt15.Value;
+    heatframe = -1;
+  } else {
+    free(roimask);
+  }
+
+  free(prevthumb);
+  free(thumb);
+  free(ring);
+  free(roimax);
+  free(roichurn);
+  roimask = NULL;
+  roimax = NULL;
+  roichurn = NULL;
+  edgefree();
+  boxfree();
+	haveprev = 0;
+  rollreset();
+  checkclose();
+  telemetryclose();
+
+  // Finish off the EDL if we were writing it as we went.  Anything after
+  // the analysed range is written from the curves as Save EDL would
+  if(streaming) {
+    streamto(si.TotalFrameNo, si.TotalFrameNo);
+    for(; streamnext < si.TotalFrameNo; streamnext++) {
+      edlframe(&streamedl, streamnext, si.TotalFrameNo);
+    }
+    edlfinish(&streamedl, si.TotalFrameNo);
+    streaming = 0;
+  }
+
+  sortdifferences(si.TotalFrameNo);
+
+	// Set a key on the thresholds so the lines appear in the animation window
+	float cutthreshold0 = sparkGetCurveValuef(SPARK_UI_CONTROL, 22, 0);
+	sparkSetCurveKey(SPARK_UI_CONTROL, 22, 0, cutthreshold0);
+	float dupthreshold0 = sparkGetCurveValuef(SPARK_UI_CONTROL, 23, 0);
+	sparkSetCurveKey(SPARK_UI_CONTROL, 23, 0, dupthreshold0);
+}
+
+// Spark deletion entry point
+void SparkUnInitialise(SparkInfoStruct si) {
+  tilefree();
+  free(heatmask);
+  free(heatthumb);
+  free(heatprev);
+  free(heatsamples);
+  free(heatrow);
+  heatmask = NULL;
+  heatrow = NULL;
+  heatthumb = heatprev = heatsamples = NULL;
+  heatsize = heatrowbytes = heatroiw = 0;
+  boxfree();
+}
+
+// Called by Flame to find out what bit-depths we support... all of them :)
+int SparkIsInputFormatSupported(SparkPixelFormat fmt) {
+  switch(fmt) {
+    case SPARKBUF_RGB_24_3x8:
+    case SPARKBUF_RGB_48_3x10:
+    case SPARKBUF_RGB_48_3x12:
+    case SPARKBUF_RGB_48_3x16_FP:
+      return 1;
+      break;
+    default:
+      return 0;
+  }
+}
+
+// Called by Flame to find out how many input clips we require
+int SparkClips(void) {
+  return 1;
+}
+
+// Convert frame count to timecode
+// No drop-frame support, fps must be an integer!
+void frame2tc(int i, char *tc) {
+	int fps = SparkInt25.Value;
+	int h = floor(i/60.0/60.0/fps);
+	int m = floor((i-h*60.0*60.0*fps) / 60.0 / fps);
+	int s = floor((i-h*60.0*60.0*fps - m*60.0*fps) / fps);
+	int f = floor(i-h*60.0*60.0*fps - m*60.0*fps - s * fps);
+	sprintf(tc, "%02d:%02d:%02d:%02d", h, m, s, f);
+}
+
+// Look for dissolves and fades in the difference curve.  These spread
+// the change over many frames so no single difference crosses the cut
+// threshold, but each frame is still above the lower dissolve threshold.
+// Twin-comparison: a run of frames between the two thresholds whose
+// differences add up to more than the cut threshold is a dissolve.  We
+// tolerate one quiet frame in the middle of a run.  Frames are fed in one
+// at a time, then once more with i == frames to finish off any open run.
+// Returns the length of a dissolve which has just been found, and sets
+// start to its first frame, otherwise returns 0
+int dissolvestep(DissolveRun *run, int i, int frames, int *start) {
+  float difference = 0.0, cutthreshold = INFINITY, dissolvethreshold = INFINITY;
+  if(i < frames) {
+    difference = sparkGetCurveValuef(SPARK_UI_CONTROL, metriccontrols[SparkPup20.Value], i);
+    cutthreshold = cutthresholdat(i);
+    dissolvethreshold = sparkGetCurveValuef(SPARK_UI_CONTROL, 14, i);
+  }
+  int inside = difference > dissolvethreshold && difference <= cutthreshold;
+  if(run->start == 0) {
+    if(inside) {
+      run->start = run->last = i;
+      run->accumulated = difference;
+      run->quiet = 0;
+    }
+    return 0;
+  }
+  if(inside) {
+    run->accumulated += difference;
+    run->last = i;
+    run->quiet = 0;
+    return 0;
+  }
+  if(difference <= dissolvethreshold && ++run->quiet <= 1 && i < frames) {
+    return 0;
+  }
+
+  // Run is over, either by going quiet or by hitting a real cut
+  int length = 0;
+  float endthreshold = cutthresholdat(run->last);
+  if(run->last - run->start + 1 >= SparkSetupInt18.Value && run->accumulated > endthreshold) {
+    length = run->last - run->start + 1;
+    *start = run->start;
+  }
+  run->start = 0;
+  if(inside) {
+    run->start = run->last = i;
+    run->accumulated = difference;
+    run->quiet = 0;
+  }
+  return length;
+}
+
+// Find all the dissolves in the clip.  Returns the length of the dissolve
+// starting at each frame, or 0, in a calloc()'d array
+int *finddissolves(int frames) {
+  int *dissolves = (int *) calloc(frames + 1, sizeof(int));
+  DissolveRun run = { 0, 0, 0, 0.0 };
+  for(int i = 1; i <= frames; i++) {
+    int start;
+    int length = dissolvestep(&run, i, frames, &start);
+    if(length > 0) {
+      dissolves[start] = length;
+    }
+  }
+  return dissolves;
+}
+
+// Start the shot so far over
+void edlshotreset(EdlWriter *e) {
+  e->shotframes = e->motionframes = 0;
+  e->lumasum = e->motionsum = 0.0;
+  e->stillest = -1;
+  e->stillestdiff = INFINITY;
+}
+
+// Open the shot table next to the EDL, named the same but ending .csv and
+// .json, if it's wanted
+void edlshotstart(EdlWriter *e) {
+  e->csv = e->json = NULL;
+  e->shots = 0;
+  edlshotreset(e);
+  if(SparkBoolean39.Value == 0) return;
+
+  int pathlen = strlen(e->path);
+  char *name = (char *) malloc(pathlen + 6);
+  strcpy(name, e->path);
+  if(pathlen > 4 && !strcmp(name + pathlen - 4, ".edl")) {
+    name[pathlen - 4] = '\0';
+  }
+  char *ext = name + strlen(name);
+  strcpy(ext, ".csv");
+  e->csv = fopen(name, "w");
+  if(e->csv == NULL) {
+    printf("CutDetective: Failed to open %s for writing\n", name);
+  } else {
+    fprintf(e->csv, "event,source_in,source_out,record_in,record_out,frames,mean_luma,motion,representative_frame,representative_tc\n");
+  }
+  strcpy(ext, ".json");
+  e->json = fopen(name, "w");
+  if(e->json == NULL) {
+    printf("CutDetective: Failed to open %s for writing\n", name);
+  } else {
+    fprintf(e->json, "[");
+  }
+  free(name);
+}
+
+// Add frame i to the shot so far.  The difference on the first frame of
+// a shot is the cut into it, so that isn't motion
+void edlshotframe(EdlWriter *e, int i, int first) {
+  if(e->csv == NULL && e->json == NULL) return;
+  e->shotframes++;
+  e->lumasum += sparkGetCurveValuef(SPARK_UI_CONTROL, 38, i);
+  if(e->stillest < 0) {
+    e->stillest = i;
+  }
+  if(!first) {
+    float difference = sparkGetCurveValuef(SPARK_UI_CONTROL, 21, i);
+    e->motionsum += difference;
+    e->motionframes++;
+    if(difference < e->stillestdiff) {
+      e->stillestdiff = difference;
+      e->stillest = i;
+    }
+  }
+}
+
+// Write the shot table row for the shot which finishes on the frame before
+// i, like edlevent() does for the EDL, then start a new shot
+void edlshot(EdlWriter *e, int i) {
+  if(e->csv == NULL && e->json == NULL) return;
+  char sourcein[13], sourceout[13], recordin[13], recordout[13], stillesttc[13];
+  frame2tc(e->prevoutpoint, sourcein);
+  frame2tc(i - 1, sourceout);
+  frame2tc(e->prevoutpoint - e->removed, recordin);
+  frame2tc(i - (e->removed + 1), recordout);
+  // Curve keys are a frame on from source frames
+  int stillest = e->stillest >= 0 ? e->stillest - 1 : e->prevoutpoint;
+  frame2tc(stillest, stillesttc);
+  int frames = i - 1 - e->prevoutpoint;
+  float luma = e->shotframes > 0 ? e->lumasum / e->shotframes : 0.0;
+  float motion = e->motionframes > 0 ? e->motionsum / e->motionframes : 0.0;
+  if(e->csv != NULL) {
+    fprintf(e->csv, "%d,%s,%s,%s,%s,%d,%.2f,%.2f,%d,%s\n", e->eventno, sourcein, sourceout, recordin, recordout, frames, luma, motion, stillest, stillesttc);
+  }
+  if(e->json != NULL) {
+    fprintf(e->json, "%s\n  {\"event\": %d, \"source_in\": \"%s\", \"source_out\": \"%s\", \"record_in\": \"%s\", \"record_out\": \"%s\", \"frames\": %d, \"mean_luma\": %.2f, \"motion\": %.2f, \"representative_frame\": %d, \"representative_tc\": \"%s\"}", e->shots > 0 ? "," : "", e->eventno, sourcein, sourceout, recordin, recordout, frames, luma, motion, stillest, stillesttc);
+  }
+  e->shots++;
+  edlshotreset(e);
+}
+
+// Close the shot table
+void edlshotfinish(EdlWriter *e) {
+  if(e->csv != NULL) {
+    fclose(e->csv);
+  }
+  if(e->json != NULL) {
+    fprintf(e->json, "\n]\n");
+    fclose(e->json);
+  }
+}
+
+// 3x5 pixel digits and a colon for labelling the contact sheet, a row of
+// three bits at a time from the top
+#define GLYPHW 3
+#define GLYPHH 5
+const unsigned short glyphs[11] = {
+  075557, 026227, 071747, 071717, 055711, 074717, 074757, 071111, 075757, 075717, 002020
+};
+
+// Write text in white on the contact sheet at x, y
+void sheettext(unsigned char *page, int pagew, int x, int y, const char *text) {
+  for(; *text != '\0'; text++, x += GLYPHW + 1) {
+    int g = *text == ':' ? 10 : *text - '0';
+    if(g < 0 || g > 10) continue;
+    for(int gy = 0; gy < GLYPHH; gy++) {
+      for(int gx = 0; gx < GLYPHW; gx++) {
+        if(glyphs[g] & (1 << ((GLYPHH - 1 - gy) * GLYPHW + GLYPHW - 1 - gx))) {
+          memset(page + ((y + gy) * pagew + x + gx) * 3, 255, 3);
+        }
+      }
+    }
+  }
+}
+
+// Note the event just written for the contact sheet, if we're making one
+void edlsheetshot(EdlWriter *e) {
+  if(e->sheet == NULL) return;
+  if(e->sheetshots == e->sheetallocated) {
+    e->sheetallocated *= 2;
+    e->sheet = (int *) realloc(e->sheet, e->sheetallocated * 2 * sizeof(int));
+  }
+  e->sheet[2 * e->sheetshots] = e->eventno;
+  e->sheet[2 * e->sheetshots + 1] = e->prevoutpoint;
+  e->sheetshots++;
+}
+
+// Write the contact sheet next to the EDL, named the same but ending .ppm.
+// Each event's first frame is tiled left to right, top to bottom, roughly
+// 16:9 overall, labelled with the event number and source timecode.  It's
+// all from the tiles kept while analysing, so no frames are read
+#define SHEETGAP 4
+void edlsheet(EdlWriter *e) {
+  if(e->sheet == NULL) return;
+  if(tilefile == NULL) {
+    printf("CutDetective: No thumbnails for the contact sheet, turn on Write contact sheet before analysing\n");
+    free(e->sheet);
+    return;
+  }
+  int pathlen = strlen(e->path);
+  char *name = (char *) malloc(pathlen + 5);
+  strcpy(name, e->path);
+  if(pathlen > 4 && !strcmp(name + pathlen - 4, ".edl")) {
+    name[pathlen - 4] = '\0';
+  }
+  strcat(name, ".ppm");
+
+  int cellw = TILEW + SHEETGAP;
+  int cellh = tileh + 2 * (GLYPHH + 2) + SHEETGAP;
+  int columns = ceil(sqrt(e->sheetshots * 16.0 / 9.0 * cellh / cellw));
+  if(columns < 1) columns = 1;
+  if(columns > e->sheetshots) columns = e->sheetshots;
+  int rows = (e->sheetshots + columns - 1) / columns;
+  int pagew = columns * cellw + SHEETGAP;
+  int pageh = rows * cellh + SHEETGAP;
+  unsigned char *page = (unsigned char *) malloc((size_t) pagew * pageh * 3);
+  memset(page, 24, (size_t) pagew * pageh * 3);
+  for(int s = 0; s < e->sheetshots; s++) {
+    int x = SHEETGAP + (s % columns) * cellw;
+    int y = SHEETGAP + (s / columns) * cellh;
+    int frame = e->sheet[2 * s + 1];
+    int have = tileread(frame);
+    for(int ty = 0; ty < tileh; ty++) {
+      unsigned char *row = page + ((y + ty) * pagew + x) * 3;
+      if(have) {
+        memcpy(row, tile + ty * TILEW * 3, TILEW * 3);
+      } else {
+        // Never analysed, so we've nothing to show
+        memset(row, 96, TILEW * 3);
+      }
+    }
+    char label[16], tc[13];
+    sprintf(label, "%d", e->sheet[2 * s]);
+    sheettext(page, pagew, x, y + tileh + 2, label);
+    frame2tc(frame, tc);
+    sheettext(page, pagew, x, y + tileh + GLYPHH + 4, tc);
+  }
+
+  FILE *fd = fopen(name, "wb");
+  if(fd == NULL) {
+    printf("CutDetective: Failed to open %s for writing\n", name);
+  } else {
+    fprintf(fd, "P6\n%d %d\n255\n", pagew, pageh);
+    fwrite(page, 3, (size_t) pagew * pageh, fd);
+    fclose(fd);
+  }
+  free(page);
+  free(name);
+  free(e->sheet);
+}
+
+// Open the EDL named in the UI and write its header
+int edlstart(EdlWriter *e, int *dissolves) {
+	e->path = strdup(SparkString11.Value);
+
+	// Sometimes strings from UI controls come back with a line break
+	int pathlen = strlen(e->path);
+	if(e->path[pathlen - 1] == '\n') {
+		e->path[pathlen - 1] = '\0';
+	}
+
+  // basename() is within its rights to trash its input
+  char *pathdup = strdup(e->path);
+  char *base = basename(pathdup);
+
+	e->fd = fopen(e->path, "w");
+  if(e->fd == NULL) {
+    printf("CutDetective: Failed to open %s for writing\n", e->path);
+    free(pathdup);
+    free(e->path);
+    return 0;
+  }
+	fprintf(e->fd, "TITLE: Cut Detective %s\n", base);
+	fprintf(e->fd, "%s", "FCM: NON-DROP FRAME\n");
+  free(pathdup);
+
+	e->eventno = 1;
+	e->prevoutpoint = 0;
+  e->removed = 0;
+  e->dupeend = -1;
+  e->cuts = 0;
+  e->dissolvecount = 0;
+  e->dissolveend = 0;
+  e->flashes = 0;
+  e->flashend = 0;
+  e->dissolves = dissolves;
+  edlshotstart(e);
+  e->sheet = NULL;
+  e->sheetshots = 0;
+  if(SparkBoolean42.Value == 1) {
+    e->sheetallocated = 256;
+    e->sheet = (int *) malloc(e->sheetallocated * 2 * sizeof(int));
+  }
+  return 1;
+}
+
+// Write an EDL event for the shot which finishes on the frame before i
+void edlevent(EdlWriter *e, int i) {
+  char sourcein[13], sourceout[13], recordin[13], recordout[13];
+  frame2tc(e->prevoutpoint, sourcein);
+  frame2tc(i - 1, sourceout);
+  frame2tc(e->prevoutpoint - e->removed, recordin);
+  frame2tc(i - (e->removed + 1), recordout);
+  fprintf(e->fd, "\n%06d  MASTER  V  C  %s %s %s %s\n", e->eventno, sourcein, sourceout, recordin, recordout);
+  edlshot(e, i);
+  edlsheetshot(e);
+}
+
+// Decide what happens at frame i and write any events that finishes.
+// Looks at the curves up to the flash history length beyond i, and the
+// dissolves must already be known up to i
+void edlframe(EdlWriter *e, int i, int frames) {
+  char cuttc[13], removedtc[13];
+	float difference = sparkGetCurveValuef(SPARK_UI_CONTROL, metriccontrols[SparkPup20.Value], i);
+	float cutthreshold = cutthresholdat(i);
+	float dupthreshold = sparkGetCurveValuef(SPARK_UI_CONTROL, SparkBoolean17.Value ? 19 : 23, i);
+  int cut = SparkBoolean15.Value == 1 && difference > cutthreshold;
+  if(cut && i == e->flashend) {
+    // Picture came back after a flash, which we already dealt with
+    cut = 0;
+  } else if(cut && SparkBoolean8.Value == 1) {
+    // If a frame shortly after this one jumps back to looking like the
+    // frame before this one, we're at the start of a flash, not a cut
+    for(int j = i + 1; j <= i + SparkSetupInt20.Value && j < frames; j++) {
+      float flashdiff = sparkGetCurveValuef(SPARK_UI_CONTROL, 6, j);
+      int flashlength = sparkGetCurveValuef(SPARK_UI_CONTROL, 7, j) + 0.5;
+      if(flashlength == j - i && flashdiff <= flashthresholdat(j)) {
+        frame2tc(i, cuttc);
+        fprintf(e->fd, "CutDetective ignored a %d frame flash at source frame %d, %s\n", j - i, i, cuttc);
+        e->flashes++;
+        e->flashend = j;
+        cut = 0;
+        break;
+      }
+    }
+  }
+  int dissolvestart = e->dissolves != NULL && e->dissolves[i] > 0;
+  int newshot = cut || dissolvestart || i == e->dissolveend;
+  if(newshot) {
+    // This frame is the first frame of a new shot, write EDL event for
+    // the shot that just finished
+    if(e->prevoutpoint != i - 1) {
+      // Only write an event if it wouldn't be zero-length
+      edlevent(e, i);
+			e->eventno++;
+      e->cuts++;
+    }
+    frame2tc(i, cuttc);
+    if(dissolvestart) {
+      // The dissolve itself becomes an event of its own, so it can be
+      // found and dealt with in the timeline
+      fprintf(e->fd, "At end of this shot CutDetective detected a %d frame dissolve starting at source frame %d, %s\n", e->dissolves[i], i, cuttc);
+      e->dissolveend = i + e->dissolves[i];
+      e->dissolvecount++;
+    } else if(i == e->dissolveend) {
+      fprintf(e->fd, "At end of this shot CutDetective detected the end of a dissolve at source frame %d, %s\n", i, cuttc);
+    }
+    if(cut) {
+      fprintf(e->fd, "At end of this shot CutDetective detected a cut at source frame %d, %s\n", i, cuttc);
+    }
+		e->prevoutpoint = i - 1; // Next shot should start on this frame, i.e. a match-cut
+	}
+  int dupe = SparkBoolean16.Value == 1 && difference < dupthreshold && i > 1;
+  if(!dupe) {
+    edlshotframe(e, i, newshot);
+  }
+  if(dupe) {
+    if(e->prevoutpoint == i - 1) {
+      // We already just finished a shot, don't write a zero-length event
+      // This happens if we're removing multiple dupes in a row, or if a
+      // dupe is the first frame of a shot, which still needs a mention
+      if(e->dupeend != i - 1) {
+        frame2tc(i, removedtc);
+        fprintf(e->fd, "CutDetective removed duplicate source frames at %d, %s\n", i, removedtc);
+      }
+      e->removed++;
+      e->prevoutpoint = i;
+      e->dupeend = i;
+      return;
+    }
+    // This frame needs to be removed, write EDL event for shot that just
+    // finished
+    edlevent(e, i);
+    frame2tc(i, removedtc);
+    fprintf(e->fd, "At end of this shot CutDetective removed duplicate source frames at %d, %s\n", i, removedtc);
+    e->eventno++;
+    e->removed++;
+    e->dupeend = i;
+    e->prevoutpoint = i; // Next shot should start on the next frame, not this one
+  }
+}
+
+// Write the last shot, close the EDL and say how it went
+void edlfinish(EdlWriter *e, int frames) {
+	// Don't forget the last shot!
+  int i = frames + 1;
+  edlshotframe(e, frames, 0);
+  edlevent(e, i);
+  fprintf(e->fd, "At end of this shot CutDetective reached end of source\n");
+	fclose(e->fd);
+  edlshotfinish(e);
+  edlsheet(e);
+
+	// Show a message in the interface
+	char *m = (char *) calloc(1000, 1);
+  float avglen = (float)(i - e->removed - 1) / (e->cuts+1);
+  sprintf(m, "%d cuts in %s, average %.1f fr, removed %d duplicates", e->cuts, e->path, avglen, e->removed);
+  if(SparkBoolean13.Value == 1) {
+    sprintf(m + strlen(m), ", %d dissolves", e->dissolvecount);
+  }
+  if(e->flashes > 0) {
+    sprintf(m + strlen(m), ", ignored %d flashes", e->flashes);
+  }
+	sparkMessage(m);
+	free(m);
+  free(e->path);
+  free(e->dissolves);
+}
+
+// Start writing the EDL while we analyse
+void streamstart(int frames) {
+  int *dissolves = NULL;
+  if(SparkBoolean13.Value == 1) {
+    dissolves = (int *) calloc(frames + 1, sizeof(int));
+  }
+  streaming = edlstart(&streamedl, dissolves);
+  if(!streaming) {
+    free(dissolves);
+    return;
+  }
+  streamnext = 1;
+  streamfed = 1;
+  memset(&streamrun, 0, sizeof(streamrun));
+}
+
+// Write everything we can be sure about now that frame upto has been
+// keyed.  Frames can't be written until we've seen far enough past them
+// to rule out a flash, or while they might be part of a dissolve
+void streamto(int upto, int frames) {
+  if(streamedl.dissolves != NULL) {
+    for(; streamfed <= upto && streamfed <= frames; streamfed++) {
+      int start;
+      int length = dissolvestep(&streamrun, streamfed, frames, &start);
+      if(length > 0) {
+        streamedl.dissolves[start] = length;
+      }
+    }
+  }
+  int last = upto;
+  if(SparkBoolean8.Value == 1) {
+    last = upto - SparkSetupInt20.Value;
+  }
+  if(streamedl.dissolves != NULL && streamrun.start != 0 && streamrun.start - 1 < last) {
+    last = streamrun.start - 1;
+  }
+  for(; streamnext <= last && streamnext < frames; streamnext++) {
+    edlframe(&streamedl, streamnext, frames);
+  }
+  fflush(streamedl.fd);
+}
+
+// Whether a curve has different values on different frames
+int curveanimated(int id, int frames) {
+  float first = sparkGetCurveValuef(SPARK_UI_CONTROL, id, 0);
+  for(int i = 1; i <= frames; i++) {
+    if(sparkGetCurveValuef(SPARK_UI_CONTROL, id, i) != first) return 1;
+  }
+  return 0;
+}
+
+// Target shots is changed, so find the cut threshold which would give that
+// many shots and set it as a key at frame 0.  Only considers cuts, before
+// flashes and dissolves.  The threshold mustn't be animated, and adaptive
+// thresholds don't use it, so we refuse rather than give a wrong count
+unsigned long *targetshotscallback(int what, SparkInfoStruct si) {
+  if(sorteddiffs == NULL) {
+    sortdifferences(si.TotalFrameNo);
+  }
+  int cuts = SparkInt26.Value - 1;
+  if(cuts < 0 || nsorted == 0) return NULL;
+  if(cuts > nsorted) cuts = nsorted;
+
+  // We can only set one fixed threshold, and can't take keys away, so
+  // leave alone anything that one key at frame 0 wouldn't control
+  if(SparkBoolean17.Value == 1) {
+    sparkMessage((char *) "Target shots sets the fixed cut threshold, turn off Adaptive thresholds to use it");
+    return NULL;
+  }
+  float before = sparkGetCurveValuef(SPARK_UI_CONTROL, 22, 0);
+  if(curveanimated(22, si.TotalFrameNo)) {
+    sparkMessage((char *) "Cut threshold is animated, delete its keys to use Target shots");
+    return NULL;
+  }
+
+  // Halfway between the last difference that shouldn't be a cut and the
+  // first that should
+  float threshold;
+  if(cuts == nsorted) {
+    threshold = sorteddiffs[0] - 0.01;
+  } else if(cuts == 0) {
+    threshold = sorteddiffs[nsorted - 1] + 0.01;
+  } else {
+    threshold = 0.5 * (sorteddiffs[nsorted - cuts - 1] + sorteddiffs[nsorted - cuts]);
+  }
+  sparkSetCurveKey(SPARK_UI_CONTROL, 22, 0, threshold);
+  if(curveanimated(22, si.TotalFrameNo)) {
+    // Its only key was after frame 0, so now it ramps from ours to that
+    sparkSetCurveKey(SPARK_UI_CONTROL, 22, 0, before);
+    sparkMessage((char *) "Cut threshold has a key after frame 0, delete it to use Target shots");
+    return NULL;
+  }
+  SparkFloat22.Value = threshold;
+  sparkControlUpdate(22);
+
+  // Ties mean we can't always hit the target exactly, so say what we got
+  float dupthreshold = sparkGetCurveValuef(SPARK_UI_CONTROL, 23, 0);
+  int got = nsorted - countbelow(threshold, 1);
+  int dupes = countbelow(dupthreshold, 0);
+  char *m = (char *) calloc(1000, 1);
+  sprintf(m, "Cut threshold %.2f gives %d shots, duplicate threshold %.2f gives %d duplicates", threshold, got + 1, dupthreshold, dupes);
+  sparkMessage(m);
+  free(m);
+
+  return NULL;
+}
+
+// Metric is changed.  The adaptive thresholds and the sorted differences
+// Target shots goes by were worked out on the metric picked while
+// analysing, so if we've analysed since, work them out again on the new one
+unsigned long *metriccallback(int what, SparkInfoStruct si) {
+  if(haveprev || sorteddiffs == NULL) return NULL;
+  adaptivecurves(si.TotalFrameNo);
+  sortdifferences(si.TotalFrameNo);
+  return NULL;
+}
+
+// Save EDL... button is clicked
+unsigned long *savebuttoncallback(int what, SparkInfoStruct si) {
+  EdlWriter e;
+  int *dissolves = NULL;
+  if(SparkBoolean13.Value == 1) {
+    dissolves = finddissolves(si.TotalFrameNo);
+  }
+  if(!edlstart(&e, dissolves)) {
+    free(dissolves);
+    sparkMessage((char *) "Couldn't open EDL for writing");
+    return NULL;
+  }
+	for(int i = 1; i < si.TotalFrameNo; i++) {
+    edlframe(&e, i, si.TotalFrameNo);
+	}
+  edlfinish(&e, si.TotalFrameNo);
+
+	return NULL;
+}
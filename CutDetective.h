@@ -0,0 +1,82 @@
+// Parts of CutDetective.cpp shared with the offline host in
+// CutDetectiveOffline.cpp, which drives the same analysis and EDL
+// writing over image sequences outside Flame
+
+#ifndef CUTDETECTIVE_H
+#define CUTDETECTIVE_H
+
+// Histogram sizes
+#define LUMABINS 64
+#define CHROMABINS 32
+#define HISTBINS (LUMABINS + 2 * CHROMABINS)
+
+// Width of the contact sheet tiles
+#define TILEW 48
+
+// Thumbnails, histograms and history ring
+extern float *prevthumb;
+extern float *thumb;
+extern int thumbw, thumbh;
+extern int hist[HISTBINS];
+extern int prevhist[HISTBINS];
+extern float *ring;
+extern int ringsize, ringcount, ringhead;
+extern int activesamples;
+extern int lumasamples;
+extern unsigned long long *edges, *prevedges;
+extern FILE *tilefile;
+extern unsigned char *tiled, *tile;
+extern int tileframes, tileh;
+
+// A pair of frames to score with scorepairs, as if b came after a, and
+// what they scored on each metric
+typedef struct {
+  int a, b;
+  float luma, motion, histogram, chroma, changed, gain, edges;
+} FramePair;
+
+// Analysis steps
+int writepixel(char *pixel, int depth, float r, float g, float b);
+void makethumb(SparkMemBufStruct *buf, int downres, float *t, int *h);
+void histcount(int *h, float l, float cb, float cr);
+void edgealloc(void);
+void edgefree(void);
+void edgemap(float *t, unsigned long long *e);
+void tilestart(int frames);
+int tilewrite(int frame);
+int tileread(int frame);
+void scoreframe(int frame);
+void flashframe(int frame);
+void adaptiveframe(int frame);
+void adaptivepush(int frame);
+void adaptivecurves(int frames);
+void ringpush(void);
+void rollreset(void);
+void sortdifferences(int frames);
+int scorepairs(FramePair *pairs, int npairs);
+
+// Spark entry points
+unsigned int SparkInitialise(SparkInfoStruct si);
+void SparkMemoryTempBuffers(void);
+unsigned long *SparkProcess(SparkInfoStruct si);
+unsigned long *SparkAnalyse(SparkInfoStruct si);
+void SparkAnalyseEnd(SparkInfoStruct si);
+unsigned long *savebuttoncallback(int what, SparkInfoStruct si);
+
+// Controls
+extern SparkFloatStruct SparkFloat6, SparkFloat7, SparkFloat10, SparkFloat14;
+extern SparkFloatStruct SparkFloat18, SparkFloat19, SparkFloat21, SparkFloat22;
+extern SparkFloatStruct SparkFloat23, SparkFloat24, SparkFloat27, SparkFloat28;
+extern SparkFloatStruct SparkFloat29, SparkFloat30, SparkFloat31, SparkFloat33;
+extern SparkFloatStruct SparkFloat38, SparkFloat40, SparkFloat41, SparkFloat43;
+extern SparkBooleanStruct SparkBoolean8, SparkBoolean9, SparkBoolean12, SparkBoolean13;
+extern SparkBooleanStruct SparkBoolean15, SparkBoolean16, SparkBoolean17, SparkBoolean35;
+extern SparkBooleanStruct SparkBoolean37, SparkBoolean39, SparkBoolean42;
+extern SparkPupStruct SparkPup20;
+extern SparkStringStruct SparkString11, SparkString36;
+extern SparkIntStruct SparkInt25, SparkInt26;
+extern SparkIntStruct SparkSetupInt15, SparkSetupInt16, SparkSetupInt17;
+extern SparkIntStruct SparkSetupInt18, SparkSetupInt19, SparkSetupInt20;
+extern SparkIntStruct SparkSetupInt21;
+
+#endif
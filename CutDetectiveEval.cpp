@@ -0,0 +1,745 @@
+// Measures how well Cut Detective finds cuts, duplicates and dissolves,
+// and how fast, by making synthetic clips where we know the answers and
+// running cutdetective over them.  Each clip is made in all four pixel
+// formats the Spark takes, and analysed at each downres factor with each
+// of a few ways of working, giving one table of speed against accuracy.
+// The shot table is checked too, and we stop if it's wrong.
+//
+// Clips are made of shots of textured shapes on a gradient, some locked
+// off, some drifting, some panning and some with the exposure going
+// up and down, all with fresh grain on every frame.  Between shots are
+// cuts or dissolves, and within them the odd duplicated frame or white
+// flash.  The answers are written next to the frames in truth.txt.
+//
+// Usage:
+//   cutdetectiveeval [options]
+//   cutdetectiveeval [options] -generate dir
+//
+// The first makes clips in a temporary directory, analyses them and
+// prints the table.  The second only makes the clips, in dir.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <libgen.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+// The four formats, as the directories they go in and how cutdetective
+// is told about them.  10 and 12-bit are both 16-bit PPMs, quantised to
+// their own number of levels first
+#define FORMATS 4
+const char *formatnames[FORMATS] = { "8-bit", "10-bit", "12-bit", "half" };
+const char *formatdirs[FORMATS] = { "8bit", "10bit", "12bit", "half" };
+int formatlevels[FORMATS] = { 255, 1023, 4095, 0 };
+
+// Ways of running the analysis.  Each metric reads on its own scale, so
+// each has its own thresholds, worked out from the curves of a few seeds.
+// Everything else, flash frames included, is left as the Spark has it.
+// A dissolve out of a pan changes each frame about as much as the pan
+// does, so expect dissolves to score well below cuts.
+// Changed pixels and edges can't tell a duplicate from a locked-off shot,
+// so aren't asked to
+typedef struct {
+  const char *name;
+  int metric;
+  int box;
+  float cut, dup, dissolve;
+} Mode;
+Mode modes[] = {
+  { "luma", 0, 0, 6.0, 0.2, 2.5 },
+  { "luma box", 0, 1, 6.5, 0.1, 2.0 },
+  { "motion", 1, 0, 5.0, 0.2, 1.5 },
+  { "histogram", 2, 0, 40.0, 0.2, 14.0 },
+  { "chroma", 3, 0, 10.0, 0.005, 3.0 },
+  { "changed", 4, 0, 50.0, 0.0, 20.0 },
+  { "gain", 5, 0, 11.0, 0.2, 6.0 },
+  { "edges", 6, 0, 50.0, 0.0, 8.0 },
+};
+#define NMODES ((int)(sizeof(modes) / sizeof(modes[0])))
+
+// Biggest downres factors we'll try, and shapes in a shot
+#define MAXDOWNRES 8
+#define MAXSHAPES 16
+
+// Grain on every pixel, either way
+#define GRAIN 0.015
+
+// What happens in a shot
+#define SHOTSTILL 0
+#define SHOTDRIFT 1
+#define SHOTPAN 2
+#define SHOTFLICKER 3
+
+typedef struct {
+  float x, y, w, h;
+  float rgb[3];
+  float stripes;
+  int round;
+} Shape;
+
+typedef struct {
+  int type;
+  float top[3], bottom[3];
+  int nshapes;
+  Shape shapes[MAXSHAPES];
+  float panx, pany;
+  float driftx, drifty;
+  float flickerrate;
+} Scene;
+
+// What's in each frame: a shot and how far into it we are, optionally
+// mixed with the next shot for a dissolve, or a flash, or a repeat of the
+// frame before
+typedef struct {
+  int shot, t;
+  int next, nextt;
+  float mix;
+  int flash, dupe;
+} Plan;
+
+int width = 480, height = 270, frames = 480, seed = 1;
+Scene *scenes;
+Plan *plan;
+
+// Random numbers we can repeat from the seed
+unsigned int randstate;
+float randf(void) {
+  randstate ^= randstate << 13;
+  randstate ^= randstate >> 17;
+  randstate ^= randstate << 5;
+  return (randstate & 0xffffff) / 16777216.0;
+}
+int randint(int lo, int hi) {
+  return lo + (int)(randf() * (hi - lo + 1));
+}
+
+// Grain for a pixel of a frame, the same each time we ask
+float grain(int x, int y, int f) {
+  unsigned int h = x * 374761393u + y * 668265263u + f * 2246822519u + seed * 3266489917u;
+  h = (h ^ (h >> 13)) * 1274126177u;
+  h ^= h >> 16;
+  return ((h & 0xffff) / 65535.0 - 0.5) * 2.0 * GRAIN;
+}
+
+void makescene(Scene *s) {
+  s->type = randint(SHOTSTILL, SHOTFLICKER);
+  for(int c = 0; c < 3; c++) {
+    s->top[c] = 0.1 + 0.6 * randf();
+    s->bottom[c] = 0.1 + 0.6 * randf();
+  }
+  s->nshapes = randint(6, MAXSHAPES);
+  for(int i = 0; i < s->nshapes; i++) {
+    Shape *p = &s->shapes[i];
+    p->x = randf();
+    p->y = randf();
+    p->w = 0.05 + 0.2 * randf();
+    p->h = 0.05 + 0.25 * randf();
+    for(int c = 0; c < 3; c++) {
+      p->rgb[c] = 0.05 + 0.9 * randf();
+    }
+    p->stripes = randf() < 0.5 ? 0.0 : 20.0 + 80.0 * randf();
+    p->round = randf() < 0.5;
+  }
+  s->panx = s->pany = s->driftx = s->drifty = 0.0;
+  s->flickerrate = 0.0;
+  if(s->type == SHOTPAN) {
+    s->panx = (randf() < 0.5 ? -1.0 : 1.0) * (0.01 + 0.02 * randf());
+    s->pany = 0.01 * (randf() - 0.5);
+  } else if(s->type == SHOTDRIFT || s->type == SHOTFLICKER) {
+    s->driftx = 0.004 * (randf() - 0.5);
+    s->drifty = 0.004 * (randf() - 0.5);
+  }
+  if(s->type == SHOTFLICKER) {
+    // A cycle every 15 to 60 frames, like an iris hunting, rather than a
+    // strobe
+    s->flickerrate = 0.1 + 0.3 * randf();
+  }
+}
+
+// Colour of a scene at u, v across and down the frame, t frames in.  The
+// shapes wrap around so pans never run out of picture
+void scenecolour(Scene *s, int t, float u, float v, float *rgb) {
+  for(int c = 0; c < 3; c++) {
+    rgb[c] = s->top[c] + (s->bottom[c] - s->top[c]) * v;
+  }
+  float su = u + s->panx * t, sv = v + s->pany * t;
+  for(int i = 0; i < s->nshapes; i++) {
+    Shape *p = &s->shapes[i];
+    float dx = su - (p->x + s->driftx * t * (i + 1));
+    float dy = sv - (p->y + s->drifty * t * (i + 1));
+    dx -= floorf(dx);
+    dy -= floorf(dy);
+    if(dx > p->w || dy > p->h) continue;
+    if(p->round) {
+      float ex = 2.0 * dx / p->w - 1.0, ey = 2.0 * dy / p->h - 1.0;
+      if(ex * ex + ey * ey > 1.0) continue;
+    }
+    float texture = p->stripes > 0.0 ? 0.85 + 0.15 * sinf(p->stripes * (dx + dy)) : 1.0;
+    for(int c = 0; c < 3; c++) {
+      rgb[c] = p->rgb[c] * texture;
+    }
+  }
+  if(s->type == SHOTFLICKER) {
+    float gain = 1.0 + 0.3 * sinf(s->flickerrate * t);
+    for(int c = 0; c < 3; c++) {
+      rgb[c] *= gain;
+    }
+  }
+}
+
+// Lay out the clip: shots of 15 to 45 frames, with a cut or sometimes a
+// dissolve between them, and now and then a duplicate or a flash well
+// inside a shot.  Writes what it did to truth
+void makeplan(FILE *truth) {
+  randstate = 2463534242u + seed * 7919;
+  scenes = (Scene *) malloc(frames * sizeof(Scene));
+  plan = (Plan *) calloc(frames, sizeof(Plan));
+  int shot = 0, f = 0, offset = 0;
+  makescene(&scenes[0]);
+  while(f < frames) {
+    int length = randint(15, 45);
+    int start = f;
+    for(; f < start + length && f < frames; f++) {
+      plan[f].shot = shot;
+      plan[f].t = offset + f - start;
+      plan[f].next = -1;
+    }
+    if(f >= frames) break;
+
+    // The last few frames of the shot might mix into the next one, which
+    // then carries on from where the mix got to
+    int dissolve = 0;
+    if(randf() < 0.2 && f + 20 < frames) {
+      dissolve = randint(6, 12);
+    }
+
+    // Maybe a duplicate and a flash somewhere in the middle, apart.  A
+    // short shot ending in a long dissolve has no middle, so gets neither
+    int dupe = -1;
+    int middle = f - dissolve - 5 >= start + 4;
+    if(randf() < 0.5 && middle) {
+      dupe = randint(start + 4, f - dissolve - 5);
+      plan[dupe].dupe = 1;
+      fprintf(truth, "dup %d\n", dupe);
+    }
+    if(randf() < 0.2 && middle) {
+      int flash = randint(start + 4, f - dissolve - 5);
+      if(flash < dupe - 2 || flash > dupe + 2) {
+        plan[flash].flash = 1;
+        fprintf(truth, "flash %d\n", flash);
+      }
+    }
+
+    shot++;
+    makescene(&scenes[shot]);
+    for(int k = 0; k < dissolve; k++) {
+      Plan *p = &plan[f - dissolve + k];
+      p->next = shot;
+      p->nextt = k;
+      p->mix = (k + 1.0) / (dissolve + 1.0);
+    }
+    offset = dissolve;
+    if(dissolve) {
+      fprintf(truth, "dissolve %d %d\n", f - dissolve, dissolve);
+    } else {
+      fprintf(truth, "cut %d\n", f);
+    }
+  }
+}
+
+// Render frame f into a float RGB buffer.  Duplicates are left as they
+// were, since the buffer still has the frame before in it
+void render(int f, float *image) {
+  Plan *p = &plan[f];
+  if(p->dupe) return;
+  for(int y = 0; y < height; y++) {
+    for(int x = 0; x < width; x++) {
+      float u = (x + 0.5) / width, v = (y + 0.5) / height;
+      float *rgb = image + (y * width + x) * 3;
+      scenecolour(&scenes[p->shot], p->t, u, v, rgb);
+      if(p->next >= 0) {
+        float other[3];
+        scenecolour(&scenes[p->next], p->nextt, u, v, other);
+        for(int c = 0; c < 3; c++) {
+          rgb[c] = (1.0 - p->mix) * rgb[c] + p->mix * other[c];
+        }
+      }
+      if(p->flash) {
+        for(int c = 0; c < 3; c++) {
+          rgb[c] = 0.3 * rgb[c] + 0.7;
+        }
+      }
+      float g = grain(x, y, f);
+      for(int c = 0; c < 3; c++) {
+        rgb[c] += g;
+        if(rgb[c] < 0.0) rgb[c] = 0.0;
+        if(rgb[c] > 1.0) rgb[c] = 1.0;
+      }
+    }
+  }
+}
+
+// Write a frame in one of the formats.  PPMs are big-endian when 16-bit,
+// and PFMs are little-endian, which the negative scale says, and bottom
+// row first
+int writeframe(const char *path, int format, float *image) {
+  FILE *fd = fopen(path, "wb");
+  if(fd == NULL) {
+    printf("CutDetective: Failed to open %s for writing\n", path);
+    return 0;
+  }
+  int n = width * height * 3;
+  int levels = formatlevels[format];
+  if(levels == 0) {
+    fprintf(fd, "PF\n%d %d\n-1.0\n", width, height);
+    for(int y = height - 1; y >= 0; y--) {
+      fwrite(image + y * width * 3, sizeof(float), width * 3, fd);
+    }
+  } else if(levels == 255) {
+    fprintf(fd, "P6\n%d %d\n255\n", width, height);
+    unsigned char *out = (unsigned char *) malloc(n);
+    for(int i = 0; i < n; i++) {
+      out[i] = image[i] * 255.0 + 0.5;
+    }
+    fwrite(out, 1, n, fd);
+    free(out);
+  } else {
+    fprintf(fd, "P6\n%d %d\n65535\n", width, height);
+    unsigned char *out = (unsigned char *) malloc(2 * n);
+    for(int i = 0; i < n; i++) {
+      int code = (int)(image[i] * levels + 0.5);
+      int v = code * 65535 / levels;
+      out[2 * i] = v >> 8;
+      out[2 * i + 1] = v & 0xff;
+    }
+    fwrite(out, 2, n, fd);
+    free(out);
+  }
+  int ok = !ferror(fd);
+  fclose(fd);
+  return ok;
+}
+
+// Make the clip in every format under dir, with the answers in
+// dir/truth.txt
+int generate(const char *dir) {
+  char path[4200];
+  mkdir(dir, 0755);
+  for(int k = 0; k < FORMATS; k++) {
+    snprintf(path, sizeof(path), "%s/%s", dir, formatdirs[k]);
+    mkdir(path, 0755);
+  }
+  snprintf(path, sizeof(path), "%s/truth.txt", dir);
+  FILE *truth = fopen(path, "w");
+  if(truth == NULL) {
+    printf("CutDetective: Failed to open %s for writing\n", path);
+    return 0;
+  }
+  fprintf(truth, "frames %d\n", frames);
+  makeplan(truth);
+  fclose(truth);
+
+  float *image = (float *) calloc(width * height * 3, sizeof(float));
+  for(int f = 0; f < frames; f++) {
+    render(f, image);
+    for(int k = 0; k < FORMATS; k++) {
+      snprintf(path, sizeof(path), "%s/%s/f%06d.%s", dir, formatdirs[k], f, formatlevels[k] == 0 ? "pfm" : "ppm");
+      if(!writeframe(path, k, image)) {
+        free(image);
+        return 0;
+      }
+    }
+  }
+  free(image);
+  return 1;
+}
+
+// The answers, and what an analysis found, as lists of frames
+typedef struct {
+  int *cuts, ncuts;
+  int *dupes, ndupes;
+  int *dissolves, *dissolvelengths, ndissolves;
+} Events;
+
+void addevent(int **list, int *n, int frame) {
+  *list = (int *) realloc(*list, (*n + 1) * sizeof(int));
+  (*list)[(*n)++] = frame;
+}
+
+int readtruth(const char *path, Events *e) {
+  FILE *fd = fopen(path, "r");
+  if(fd == NULL) {
+    printf("CutDetective: Failed to open %s\n", path);
+    return 0;
+  }
+  memset(e, 0, sizeof(Events));
+  char what[16];
+  int a, b;
+  while(fscanf(fd, "%15s %d", what, &a) == 2) {
+    if(!strcmp(what, "cut")) addevent(&e->cuts, &e->ncuts, a);
+    else if(!strcmp(what, "dup")) addevent(&e->dupes, &e->ndupes, a);
+    else if(!strcmp(what, "dissolve") && fscanf(fd, "%d", &b) == 1) {
+      int n = e->ndissolves;
+      addevent(&e->dissolves, &e->ndissolves, a);
+      addevent(&e->dissolvelengths, &n, b);
+    }
+  }
+  fclose(fd);
+  return 1;
+}
+
+// What the EDL says.  Source frames in its comments count from 1
+int readedl(const char *path, Events *e) {
+  FILE *fd = fopen(path, "r");
+  if(fd == NULL) {
+    printf("CutDetective: Failed to open %s\n", path);
+    return 0;
+  }
+  memset(e, 0, sizeof(Events));
+  char line[1024];
+  while(fgets(line, sizeof(line), fd) != NULL) {
+    int frame, length;
+    char *at;
+    if((at = strstr(line, "detected a cut at source frame ")) != NULL && sscanf(at, "detected a cut at source frame %d", &frame) == 1) {
+      addevent(&e->cuts, &e->ncuts, frame - 1);
+    } else if((at = strstr(line, "removed duplicate source frames at ")) != NULL && sscanf(at, "removed duplicate source frames at %d", &frame) == 1) {
+      addevent(&e->dupes, &e->ndupes, frame - 1);
+    } else if((at = strstr(line, "detected a ")) != NULL && sscanf(at, "detected a %d frame dissolve starting at source frame %d", &length, &frame) == 2) {
+      int n = e->ndissolves;
+      addevent(&e->dissolves, &e->ndissolves, frame - 1);
+      addevent(&e->dissolvelengths, &n, length);
+    }
+  }
+  fclose(fd);
+  return 1;
+}
+
+void freeevents(Events *e) {
+  free(e->cuts);
+  free(e->dupes);
+  free(e->dissolves);
+  free(e->dissolvelengths);
+}
+
+// Which dissolve frame is inside, or -1
+int indissolve(Events *truth, int frame) {
+  for(int i = 0; i < truth->ndissolves; i++) {
+    if(frame >= truth->dissolves[i] - 1 && frame < truth->dissolves[i] + truth->dissolvelengths[i] + 1) return i;
+  }
+  return -1;
+}
+
+// How many of found are within slack frames of one in wanted, each
+// one in wanted only matching once
+int matches(int *found, int nfound, int *wanted, int nwanted, int slack) {
+  char *used = (char *) calloc(nwanted + 1, 1);
+  int matched = 0;
+  for(int i = 0; i < nfound; i++) {
+    for(int j = 0; j < nwanted; j++) {
+      if(!used[j] && abs(found[i] - wanted[j]) <= slack) {
+        used[j] = 1;
+        matched++;
+        break;
+      }
+    }
+  }
+  free(used);
+  return matched;
+}
+
+// Scores for one analysis.  Every frame is counted from 0, as in
+// truth.txt, so a cut is the first frame of the new shot and a duplicate
+// is the repeat.  A cut found a frame either side of a real one matches
+// it, so being out by one isn't scored as a miss and a false cut both,
+// but a duplicate has to be the frame itself.  A dissolve counts as found
+// if a dissolve or a cut was found from the frame before it starts to the
+// frame after it ends, and cuts found there aren't held against the cut
+// precision.  Dissolves found anywhere else are held against the dissolve
+// precision
+typedef struct {
+  float cutprecision, cutrecall;
+  float dupprecision, duprecall;
+  float dissolveprecision, dissolverecall;
+} Score;
+
+float ratio(int a, int b) {
+  return b > 0 ? 100.0 * a / b : 100.0;
+}
+
+void score(Events *truth, Events *found, Score *s) {
+  int *cuts = (int *) malloc((found->ncuts + 1) * sizeof(int));
+  int ncuts = 0;
+  char *dissolvehit = (char *) calloc(truth->ndissolves + 1, 1);
+  for(int i = 0; i < found->ncuts; i++) {
+    int d = indissolve(truth, found->cuts[i]);
+    if(d >= 0) {
+      dissolvehit[d] = 1;
+    } else {
+      cuts[ncuts++] = found->cuts[i];
+    }
+  }
+  int dissolvematches = 0;
+  for(int i = 0; i < found->ndissolves; i++) {
+    int d = indissolve(truth, found->dissolves[i]);
+    if(d >= 0) {
+      dissolvehit[d] = 1;
+      dissolvematches++;
+    }
+  }
+  int hits = 0;
+  for(int i = 0; i < truth->ndissolves; i++) {
+    hits += dissolvehit[i];
+  }
+  int cutmatches = matches(cuts, ncuts, truth->cuts, truth->ncuts, 1);
+  int dupmatches = matches(found->dupes, found->ndupes, truth->dupes, truth->ndupes, 0);
+  s->cutprecision = ratio(cutmatches, ncuts);
+  s->cutrecall = ratio(cutmatches, truth->ncuts);
+  s->dupprecision = ratio(dupmatches, found->ndupes);
+  s->duprecall = ratio(dupmatches, truth->ndupes);
+  s->dissolveprecision = ratio(dissolvematches, found->ndissolves);
+  s->dissolverecall = ratio(hits, truth->ndissolves);
+  free(cuts);
+  free(dissolvehit);
+}
+
+// Timecode rate we ask for, so the shot table can be read back
+#define FPS 24
+
+int tc2frame(const char *tc) {
+  int h, m, s, f;
+  if(sscanf(tc, "%d:%d:%d:%d", &h, &m, &s, &f) != 4) return -1;
+  return ((h * 60 + m) * 60 + s) * FPS + f;
+}
+
+// How many shots in the table next to the EDL have their representative
+// frame outside them, or -1 if it can't be read.  Source out is the frame
+// after the shot, like in the EDL
+int checkshots(const char *edl) {
+  char path[4200], line[1024], in[16], out[16];
+  snprintf(path, sizeof(path), "%.*s.csv", (int) strlen(edl) - 4, edl);
+  FILE *fd = fopen(path, "r");
+  if(fd == NULL) {
+    printf("CutDetective: Failed to open %s\n", path);
+    return -1;
+  }
+  int bad = 0, representative;
+  while(fgets(line, sizeof(line), fd) != NULL) {
+    if(sscanf(line, "%*d,%15[^,],%15[^,],%*[^,],%*[^,],%*d,%*f,%*f,%d", in, out, &representative) != 3) continue;
+    if(representative < tc2frame(in) || representative >= tc2frame(out)) bad++;
+  }
+  fclose(fd);
+  unlink(path);
+  snprintf(path, sizeof(path), "%.*s.json", (int) strlen(edl) - 4, edl);
+  unlink(path);
+  return bad;
+}
+
+double seconds(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+// Run cutdetective with args, its output thrown away, and say whether it
+// worked
+int run(const char *program, char **args) {
+  pid_t pid = fork();
+  if(pid < 0) {
+    printf("CutDetective: Failed to fork\n");
+    return 0;
+  }
+  if(pid == 0) {
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, 1);
+    execv(program, args);
+    _exit(127);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// Analyse every format at every downres in every mode, and print a line
+// for each
+int evaluate(const char *dir, const char *program, int *downres, int ndownres) {
+  char path[4200], truthpath[4200], edl[4200];
+  snprintf(truthpath, sizeof(truthpath), "%s/truth.txt", dir);
+  Events truth;
+  if(!readtruth(truthpath, &truth)) return 0;
+  printf("%d frames %dx%d, %d cuts, %d duplicates, %d dissolves\n", frames, width, height, truth.ncuts, truth.ndupes, truth.ndissolves);
+  printf("Precision and recall are percentages, speed includes reading the frames\n\n");
+  printf("%-7s %7s %-10s %7s %7s %7s %7s %7s %7s %8s\n", "format", "downres", "mode", "cut P", "cut R", "dup P", "dup R", "diss P", "diss R", "frames/s");
+  for(int k = 0; k < FORMATS; k++) {
+    snprintf(path, sizeof(path), "%s/%s", dir, formatdirs[k]);
+    for(int d = 0; d < ndownres; d++) {
+      for(int m = 0; m < NMODES; m++) {
+        Mode *mode = &modes[m];
+        char downresarg[16], metric[16], cut[16], dup[16], dissolve[16], fps[16];
+        snprintf(downresarg, sizeof(downresarg), "%d", downres[d]);
+        snprintf(metric, sizeof(metric), "%d", mode->metric);
+        snprintf(cut, sizeof(cut), "%g", mode->cut);
+        snprintf(dup, sizeof(dup), "%g", mode->dup);
+        snprintf(dissolve, sizeof(dissolve), "%g", mode->dissolve);
+        snprintf(fps, sizeof(fps), "%d", FPS);
+        snprintf(edl, sizeof(edl), "%s/%s_%d_%d.edl", dir, formatdirs[k], downres[d], m);
+        char *args[24];
+        int n = 0;
+        args[n++] = (char *) program;
+        args[n++] = (char *) "-dupes";
+        args[n++] = (char *) "-downres";
+        args[n++] = downresarg;
+        args[n++] = (char *) "-metric";
+        args[n++] = metric;
+        args[n++] = (char *) "-cut";
+        args[n++] = cut;
+        args[n++] = (char *) "-dup";
+        args[n++] = dup;
+        args[n++] = (char *) "-dissolves";
+        args[n++] = dissolve;
+        args[n++] = (char *) "-edl";
+        args[n++] = edl;
+        args[n++] = (char *) "-shots";
+        args[n++] = (char *) "-fps";
+        args[n++] = fps;
+        if(mode->box) args[n++] = (char *) "-box";
+        if(formatlevels[k] == 1023) {
+          args[n++] = (char *) "-depth";
+          args[n++] = (char *) "10";
+        }
+        args[n++] = path;
+        args[n] = NULL;
+        double start = seconds();
+        if(!run(program, args)) {
+          printf("CutDetective: %s failed on %s\n", program, path);
+          freeevents(&truth);
+          return 0;
+        }
+        double took = seconds() - start;
+        Events found;
+        if(!readedl(edl, &found)) {
+          freeevents(&truth);
+          return 0;
+        }
+        int bad = checkshots(edl);
+        if(bad != 0) {
+          if(bad > 0) printf("CutDetective: %d shots in %s are represented by a frame outside them\n", bad, edl);
+          freeevents(&found);
+          freeevents(&truth);
+          return 0;
+        }
+        Score s;
+        score(&truth, &found, &s);
+        printf("%-7s %7d %-10s %7.1f %7.1f ", formatnames[k], downres[d], mode->name, s.cutprecision, s.cutrecall);
+        if(mode->dup > 0.0) {
+          printf("%7.1f %7.1f ", s.dupprecision, s.duprecall);
+        } else {
+          printf("%7s %7s ", "-", "-");
+        }
+        printf("%7.1f %7.1f %8.1f\n", s.dissolveprecision, s.dissolverecall, frames / took);
+        fflush(stdout);
+        freeevents(&found);
+        unlink(edl);
+      }
+    }
+  }
+  freeevents(&truth);
+  return 1;
+}
+
+// Remove the clips we made
+void cleanup(const char *dir) {
+  char path[4200];
+  for(int k = 0; k < FORMATS; k++) {
+    for(int f = 0; f < frames; f++) {
+      snprintf(path, sizeof(path), "%s/%s/f%06d.%s", dir, formatdirs[k], f, formatlevels[k] == 0 ? "pfm" : "ppm");
+      unlink(path);
+    }
+    snprintf(path, sizeof(path), "%s/%s", dir, formatdirs[k]);
+    rmdir(path);
+  }
+  snprintf(path, sizeof(path), "%s/truth.txt", dir);
+  unlink(path);
+  rmdir(dir);
+}
+
+void usage(void) {
+  printf("Usage: cutdetectiveeval [options]\n");
+  printf("       cutdetectiveeval [options] -generate dir\n");
+  printf("Options:\n");
+  printf("  -size w h          frame size, default %dx%d\n", width, height);
+  printf("  -frames n          clip length, default %d\n", frames);
+  printf("  -seed n            which clip to make, default %d\n", seed);
+  printf("  -downres a,b,...   downres factors to try, default 2,4,8\n");
+  printf("  -keep dir          make the clips in dir and leave them there\n");
+  printf("  -cutdetective path analyser to run, default the one next to us\n");
+}
+
+int main(int argc, char **argv) {
+  const char *generateonly = NULL, *keep = NULL;
+  char program[4200];
+  char *self = strdup(argv[0]);
+  snprintf(program, sizeof(program), "%s/cutdetective", dirname(self));
+  free(self);
+  int downres[MAXDOWNRES] = { 2, 4, 8 };
+  int ndownres = 3;
+  for(int i = 1; i < argc; i++) {
+    const char *o = argv[i];
+    int more = argc - i - 1;
+    if(!strcmp(o, "-size") && more >= 2) {
+      width = atoi(argv[++i]);
+      height = atoi(argv[++i]);
+    }
+    else if(!strcmp(o, "-frames") && more >= 1) frames = atoi(argv[++i]);
+    else if(!strcmp(o, "-seed") && more >= 1) seed = atoi(argv[++i]);
+    else if(!strcmp(o, "-downres") && more >= 1) {
+      ndownres = 0;
+      for(char *d = strtok(argv[++i], ","); d != NULL && ndownres < MAXDOWNRES; d = strtok(NULL, ",")) {
+        downres[ndownres++] = atoi(d);
+      }
+    }
+    else if(!strcmp(o, "-keep") && more >= 1) keep = argv[++i];
+    else if(!strcmp(o, "-generate") && more >= 1) generateonly = argv[++i];
+    else if(!strcmp(o, "-cutdetective") && more >= 1) snprintf(program, sizeof(program), "%s", argv[++i]);
+    else {
+      usage();
+      return 1;
+    }
+  }
+  if(width < 64 || height < 64 || frames < 60 || ndownres < 1) {
+    printf("CutDetective: Clips need to be at least 64x64 and 60 frames\n");
+    return 1;
+  }
+  for(int d = 0; d < ndownres; d++) {
+    if(downres[d] < 1 || width / downres[d] < 8 || height / downres[d] < 8) {
+      printf("CutDetective: Downres %d is too big for %dx%d\n", downres[d], width, height);
+      return 1;
+    }
+  }
+
+  if(generateonly != NULL) {
+    return generate(generateonly) ? 0 : 1;
+  }
+  if(access(program, X_OK) != 0) {
+    printf("CutDetective: Can't run %s, build it with make offline or use -cutdetective\n", program);
+    return 1;
+  }
+  char tmp[] = "/tmp/cutdetectiveeval.XXXXXX";
+  const char *dir = keep;
+  if(dir == NULL) {
+    dir = mkdtemp(tmp);
+    if(dir == NULL) {
+      printf("CutDetective: Failed to make a temporary directory\n");
+      return 1;
+    }
+  }
+  int ok = generate(dir) && evaluate(dir, program, downres, ndownres);
+  if(keep == NULL) {
+    cleanup(dir);
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,132 @@
+// Shows how every Cut Detective analysis on this machine which has
+// "Publish progress" on is getting on, by polling the shared memory each
+// one publishes in.  Never holds up the analyses themselves
+//
+// Usage:
+//   cutdetectivemonitor [-once] [-interval seconds] [pid ...]
+//
+// With no pids, looks for them all in /dev/shm
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include "CutDetectiveTelemetry.h"
+
+// Updates further apart than this mean something's wrong
+#define STALLSECONDS 10.0
+
+// Copy the newest update out of a segment.  Gives up if the analysis is
+// going so fast it keeps lapping us, which a second later won't matter
+int readlatest(TelemetrySegment *t, TelemetryRecord *r) {
+  for(int tries = 0; tries < 10; tries++) {
+    unsigned long long written = __atomic_load_n(&t->written, __ATOMIC_ACQUIRE);
+    if(written == 0) return 0;
+    memcpy(r, &t->ring[(written - 1) % TELEMETRYSLOTS], sizeof(TelemetryRecord));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    unsigned long long after = __atomic_load_n(&t->written, __ATOMIC_ACQUIRE);
+    if(after - written < TELEMETRYSLOTS - 1) return 1;
+  }
+  return 0;
+}
+
+// Print one line about the analysis in process pid
+void show(int pid, double now) {
+  char name[64];
+  sprintf(name, "%s%d", TELEMETRYPREFIX, pid);
+  int fd = shm_open(name, O_RDONLY, 0);
+  if(fd < 0) {
+    printf("%7d  not analysing\n", pid);
+    return;
+  }
+  void *m = mmap(NULL, sizeof(TelemetrySegment), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(m == MAP_FAILED) {
+    printf("%7d  can't read progress\n", pid);
+    return;
+  }
+  TelemetrySegment *t = (TelemetrySegment *) m;
+  TelemetryRecord r;
+  if(memcmp(t->magic, TELEMETRYMAGIC, 8) || !readlatest(t, &r)) {
+    printf("%7d  starting\n", pid);
+    munmap(m, sizeof(TelemetrySegment));
+    return;
+  }
+
+  const char *state = "analysing";
+  if(__atomic_load_n(&t->finished, __ATOMIC_ACQUIRE)) {
+    state = "finished";
+  } else if(kill(pid, 0) != 0 && errno == ESRCH) {
+    state = "DIED";
+  } else if(now - r.updated > STALLSECONDS) {
+    state = "STALLED";
+  }
+  char eta[16] = "-";
+  if(r.fps > 0.0 && r.total > r.frame) {
+    int s = (r.total - r.frame) / r.fps;
+    sprintf(eta, "%d:%02d:%02d", s / 3600, (s / 60) % 60, s % 60);
+  }
+  printf("%7d  %-9s %6d/%-6d %7.1f fps  ETA %9s  diff %6.2f  %5d cuts  %s\n", pid, state, r.frame, r.total, r.fps, eta, r.difference, r.cuts, t->edl);
+  munmap(m, sizeof(TelemetrySegment));
+}
+
+// Every process with a segment in /dev/shm
+int findpids(int *pids, int max) {
+  int n = 0;
+  DIR *dir = opendir("/dev/shm");
+  if(dir == NULL) return 0;
+  struct dirent *d;
+  int prefixlen = strlen(TELEMETRYPREFIX) - 1;
+  while((d = readdir(dir)) != NULL && n < max) {
+    if(!strncmp(d->d_name, TELEMETRYPREFIX + 1, prefixlen)) {
+      pids[n++] = atoi(d->d_name + prefixlen);
+    }
+  }
+  closedir(dir);
+  return n;
+}
+
+int main(int argc, char **argv) {
+  int once = 0;
+  float interval = 1.0;
+  int pids[1024], npids = 0;
+  for(int i = 1; i < argc; i++) {
+    if(!strcmp(argv[i], "-once")) once = 1;
+    else if(!strcmp(argv[i], "-interval") && i + 1 < argc) interval = atof(argv[++i]);
+    else if(npids < 1024 && atoi(argv[i]) > 0) pids[npids++] = atoi(argv[i]);
+    else {
+      printf("Usage: cutdetectivemonitor [-once] [-interval seconds] [pid ...]\n");
+      return 1;
+    }
+  }
+
+  while(1) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    double now = tv.tv_sec + tv.tv_usec / 1000000.0;
+    int found[1024];
+    int n = npids;
+    if(npids > 0) {
+      memcpy(found, pids, npids * sizeof(int));
+    } else {
+      n = findpids(found, 1024);
+    }
+    if(n == 0) {
+      printf("No analyses publishing progress\n");
+    }
+    for(int i = 0; i < n; i++) {
+      show(found[i], now);
+    }
+    fflush(stdout);
+    if(once) break;
+    usleep(interval * 1000000);
+    printf("\n");
+  }
+  return 0;
+}
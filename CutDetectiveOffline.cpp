@@ -0,0 +1,1347 @@
+// Runs Cut Detective's analysis outside Flame, over a sequence of PPM or
+// PFM frames, by playing the part of the Spark host.  Long clips can be
+// split into frame ranges analysed by separate processes, on separate
+// machines if need be, each writing a partial result file.  Merging those
+// gives the same curves and EDL as analysing the whole clip in one go.
+//
+// Usage:
+//   cutdetective [options] frames
+//   cutdetective [options] -range first last -part shard.cdpart frames
+//   cutdetective [options] -merge shard1.cdpart shard2.cdpart ...
+//   cutdetective [options] -batch [-jobs n] [-chunk n] clips ...
+//   cutdetective [options] -pairs list frames
+//   cutdetective [options] -bench [width height]
+//
+// frames is a directory of .ppm or .pfm files, which are read in name
+// order, or a text file listing one frame per line.  Frame numbers count
+// from 0 and ranges include both ends.  Give the merge the same options
+// as the shards.  In batch mode each clip is a sequence like frames, or a
+// directory of them, and -edl is the directory to write the EDLs in.
+
+#include <stdlib.h>
+#include <math.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <libgen.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <map>
+#include "half.h"
+#include "sparkOffline.h"
+#include "CutDetective.h"
+
+// Partial result files start with this, and the version is in it
+#define PARTMAGIC "CDPART5\n"
+
+// Frames we're analysing and the format they're in
+char **paths = NULL;
+int npaths = 0;
+int width, height, depth, pixelbytes;
+
+// The three image buffers the Spark asks for: result, front and the one
+// it registers for the previous frame
+unsigned char *buffers[4];
+
+// Frames outside first to last are never read, we pretend the clip is
+// clamped to the range like Flame does at the ends of a clip
+int rangefirst, rangelast;
+
+// Animation curves, keyed by control then frame
+std::map<int, std::map<int, float> > curves;
+
+// Curves a partial result carries, everything else is either an input
+// or is worked out again when merging
+int partcurves[] = { 6, 7, 21, 27, 28, 29, 30, 38, 40, 41 };
+#define NPARTCURVES (sizeof(partcurves) / sizeof(partcurves[0]))
+
+// Everything one partial result file holds.  Thumbnails are kept for
+// the first and last frames so the pair across each seam can be scored,
+// and enough luma planes either side to redo the flash history.  If a
+// contact sheet is wanted, every frame's tile comes too, at the end where
+// the merge can copy them across without reading them all in at once
+typedef struct {
+  int total, first, last;
+  int width, height, downres, radius, history, box, tileh;
+  int ncurves;
+  int controls[NPARTCURVES];
+  float *values[NPARTCURVES];
+  float *firstthumb, *lastthumb;
+  float *firsthistory, *lasthistory;
+  const char *path;
+  long tiles;
+} Part;
+
+// Float controls by ID, so curves with no keys can fall back to them
+SparkFloatStruct *floatcontrol(int id) {
+  switch(id) {
+    case 6: return &SparkFloat6;
+    case 7: return &SparkFloat7;
+    case 10: return &SparkFloat10;
+    case 14: return &SparkFloat14;
+    case 18: return &SparkFloat18;
+    case 19: return &SparkFloat19;
+    case 21: return &SparkFloat21;
+    case 22: return &SparkFloat22;
+    case 23: return &SparkFloat23;
+    case 24: return &SparkFloat24;
+    case 27: return &SparkFloat27;
+    case 28: return &SparkFloat28;
+    case 29: return &SparkFloat29;
+    case 30: return &SparkFloat30;
+    case 31: return &SparkFloat31;
+    case 33: return &SparkFloat33;
+    case 38: return &SparkFloat38;
+    case 40: return &SparkFloat40;
+    case 41: return &SparkFloat41;
+    case 43: return &SparkFloat43;
+    default: return NULL;
+  }
+}
+
+// Spark API, as much of it as CutDetective.cpp uses
+
+int sparkMemRegisterBuffer(void) {
+  return 3;
+}
+
+int sparkMemGetBuffer(int id, SparkMemBufStruct *b) {
+  if(id < 1 || id > 3) return 0;
+  if(buffers[id] == NULL) {
+    buffers[id] = (unsigned char *) calloc(width * height, pixelbytes);
+  }
+  b->Buffer = (unsigned long *) buffers[id];
+  b->BufWidth = width;
+  b->BufHeight = height;
+  b->BufDepth = depth;
+  b->BufSize = width * height * pixelbytes;
+  b->BufState = MEMBUF_LOCKED;
+  b->Stride = width * pixelbytes;
+  b->Inc = pixelbytes;
+  return 1;
+}
+
+void sparkCopyBuffer(unsigned long *from, unsigned long *to) {
+  memcpy(to, from, width * height * pixelbytes);
+}
+
+void sparkSetCurveKey(int type, int control, int frame, float value) {
+  curves[control][frame] = value;
+}
+
+// Linear between keys and flat beyond the first and last, or the
+// control's value if there are no keys at all
+float sparkGetCurveValuef(int type, int control, int frame) {
+  std::map<int, float> &keys = curves[control];
+  if(keys.empty()) {
+    SparkFloatStruct *f = floatcontrol(control);
+    return f != NULL ? f->Value : 0.0;
+  }
+  std::map<int, float>::iterator after = keys.lower_bound(frame);
+  if(after == keys.end()) return keys.rbegin()->second;
+  if(after->first == frame || after == keys.begin()) return after->second;
+  std::map<int, float>::iterator before = after;
+  --before;
+  float t = (float)(frame - before->first) / (after->first - before->first);
+  return before->second + t * (after->second - before->second);
+}
+
+void sparkControlUpdate(int control) {
+}
+
+void sparkMessage(char *message) {
+  printf("CutDetective: %s\n", message);
+}
+
+// Read the header of a PPM or PFM, leaving fd at the first pixel.  Sets
+// maxval to the PPM maximum, or the PFM scale which is negative for
+// little-endian
+int readheader(FILE *fd, char *magic, int *w, int *h, float *maxval) {
+  if(fscanf(fd, "%2s", magic) != 1) return 0;
+  if(strcmp(magic, "P6") && strcmp(magic, "PF")) return 0;
+  int c;
+  int got = 0;
+  float v[3];
+  while(got < 3) {
+    c = fgetc(fd);
+    if(c == EOF) return 0;
+    if(c == '#') {
+      while(c != '\n' && c != EOF) c = fgetc(fd);
+    } else if(!isspace(c)) {
+      ungetc(c, fd);
+      if(fscanf(fd, "%f", &v[got++]) != 1) return 0;
+    }
+  }
+  fgetc(fd);
+  *w = v[0];
+  *h = v[1];
+  *maxval = v[2];
+  return 1;
+}
+
+// Load frame i into a buffer in our pixel format.  16-bit PPMs are
+// big-endian and PFMs are stored bottom row first
+int loadframe(int i, unsigned char *buffer) {
+  FILE *fd = fopen(paths[i], "rb");
+  if(fd == NULL) {
+    printf("CutDetective: Failed to open %s\n", paths[i]);
+    return 0;
+  }
+  char magic[3];
+  int w, h;
+  float maxval;
+  if(!readheader(fd, magic, &w, &h, &maxval) || w != width || h != height) {
+    printf("CutDetective: %s isn't a %dx%d PPM or PFM\n", paths[i], width, height);
+    fclose(fd);
+    return 0;
+  }
+  int ok = 1;
+  if(depth == SPARKBUF_RGB_24_3x8) {
+    ok = fread(buffer, 3, w * h, fd) == (size_t)(w * h);
+  } else if(depth == SPARKBUF_RGB_48_3x16_FP) {
+    float *row = (float *) malloc(w * 3 * sizeof(float));
+    for(int y = h - 1; y >= 0 && ok; y--) {
+      ok = fread(row, sizeof(float), w * 3, fd) == (size_t)(w * 3);
+      half *out = (half *)(buffer + y * w * pixelbytes);
+      for(int x = 0; x < w * 3; x++) {
+        out[x] = row[x];
+      }
+    }
+    free(row);
+  } else {
+    unsigned char *row = (unsigned char *) malloc(w * 6);
+    for(int y = 0; y < h && ok; y++) {
+      ok = fread(row, 6, w, fd) == (size_t) w;
+      unsigned short *out = (unsigned short *)(buffer + y * w * pixelbytes);
+      for(int x = 0; x < w * 3; x++) {
+        out[x] = (row[2 * x] << 8) | row[2 * x + 1];
+      }
+    }
+    free(row);
+  }
+  fclose(fd);
+  if(!ok) {
+    printf("CutDetective: %s is too short\n", paths[i]);
+  }
+  return ok;
+}
+
+int sparkGetFrame(int clip, int frame, unsigned long *buffer) {
+  if(frame < rangefirst) frame = rangefirst;
+  if(frame > rangelast) frame = rangelast;
+  return loadframe(frame, (unsigned char *) buffer);
+}
+
+int comparepaths(const void *a, const void *b) {
+  return strcmp(*(char **) a, *(char **) b);
+}
+
+// Find the frames, either every PPM or PFM in a directory or each line of
+// a text file
+int findframes(const char *input) {
+  DIR *dir = opendir(input);
+  int allocated = 1024;
+  npaths = 0;
+  paths = (char **) malloc(allocated * sizeof(char *));
+  if(dir != NULL) {
+    struct dirent *d;
+    while((d = readdir(dir)) != NULL) {
+      int len = strlen(d->d_name);
+      if(len < 4 || (strcmp(d->d_name + len - 4, ".ppm") && strcmp(d->d_name + len - 4, ".pfm"))) continue;
+      if(npaths == allocated) {
+        allocated *= 2;
+        paths = (char **) realloc(paths, allocated * sizeof(char *));
+      }
+      paths[npaths] = (char *) malloc(strlen(input) + len + 2);
+      sprintf(paths[npaths++], "%s/%s", input, d->d_name);
+    }
+    closedir(dir);
+    qsort(paths, npaths, sizeof(char *), comparepaths);
+  } else {
+    FILE *fd = fopen(input, "r");
+    if(fd == NULL) {
+      printf("CutDetective: Can't read frames from %s\n", input);
+      return 0;
+    }
+    char line[4096];
+    while(fgets(line, sizeof(line), fd) != NULL) {
+      line[strcspn(line, "\r\n")] = '\0';
+      if(line[0] == '\0') continue;
+      if(npaths == allocated) {
+        allocated *= 2;
+        paths = (char **) realloc(paths, allocated * sizeof(char *));
+      }
+      paths[npaths++] = strdup(line);
+    }
+    fclose(fd);
+  }
+  if(npaths < 2) {
+    printf("CutDetective: Need at least 2 frames in %s\n", input);
+    return 0;
+  }
+  return 1;
+}
+
+void freeframes(void) {
+  for(int i = 0; i < npaths; i++) {
+    free(paths[i]);
+  }
+  free(paths);
+  paths = NULL;
+  npaths = 0;
+}
+
+// Work out the size and pixel format from the first frame.  8-bit PPMs
+// are 3x8, deeper ones 3x12 unless told they're 10-bit, and PFMs are half
+int findformat(int tenbit) {
+  FILE *fd = fopen(paths[0], "rb");
+  if(fd == NULL) {
+    printf("CutDetective: Failed to open %s\n", paths[0]);
+    return 0;
+  }
+  char magic[3];
+  float maxval;
+  int ok = readheader(fd, magic, &width, &height, &maxval);
+  fclose(fd);
+  if(!ok) {
+    printf("CutDetective: %s isn't a PPM or PFM\n", paths[0]);
+    return 0;
+  }
+  if(!strcmp(magic, "PF")) {
+    if(maxval > 0.0) {
+      printf("CutDetective: %s is a big-endian PFM, only little-endian is supported\n", paths[0]);
+      return 0;
+    }
+    depth = SPARKBUF_RGB_48_3x16_FP;
+    pixelbytes = 6;
+  } else if(maxval < 256) {
+    depth = SPARKBUF_RGB_24_3x8;
+    pixelbytes = 3;
+  } else {
+    depth = tenbit ? SPARKBUF_RGB_48_3x10 : SPARKBUF_RGB_48_3x12;
+    pixelbytes = 6;
+  }
+  return 1;
+}
+
+// Write every keyed curve as lines of control, frame and value
+void writecurves(const char *path) {
+  FILE *fd = fopen(path, "w");
+  if(fd == NULL) {
+    printf("CutDetective: Failed to open %s for writing\n", path);
+    return;
+  }
+  std::map<int, std::map<int, float> >::iterator c;
+  for(c = curves.begin(); c != curves.end(); ++c) {
+    std::map<int, float>::iterator k;
+    for(k = c->second.begin(); k != c->second.end(); ++k) {
+      fprintf(fd, "%d %d %.6g\n", c->first, k->first, k->second);
+    }
+  }
+  fclose(fd);
+}
+
+// Write what we found in our range to a partial result file
+int writepart(const char *path, Part *p) {
+  FILE *fd = fopen(path, "wb");
+  if(fd == NULL) {
+    printf("CutDetective: Failed to open %s for writing\n", path);
+    return 0;
+  }
+  int n = thumbw * thumbh;
+  int frames = p->last - p->first + 1;
+  p->tileh = tilefile != NULL ? tileh : 0;
+  int header[10] = { p->total, p->first, p->last, p->width, p->height, p->downres, p->radius, p->history, p->box, p->tileh };
+  fwrite(PARTMAGIC, 1, 8, fd);
+  fwrite(header, sizeof(int), 10, fd);
+  p->ncurves = 0;
+  for(unsigned int c = 0; c < NPARTCURVES; c++) {
+    if(!curves[partcurves[c]].empty()) {
+      p->controls[p->ncurves++] = partcurves[c];
+    }
+  }
+  fwrite(&p->ncurves, sizeof(int), 1, fd);
+  float *values = (float *) malloc(frames * sizeof(float));
+  for(int c = 0; c < p->ncurves; c++) {
+    for(int i = 0; i < frames; i++) {
+      values[i] = sparkGetCurveValuef(SPARK_UI_CONTROL, p->controls[c], p->first + i + 1);
+    }
+    fwrite(&p->controls[c], sizeof(int), 1, fd);
+    fwrite(values, sizeof(float), frames, fd);
+  }
+  free(values);
+  fwrite(p->firstthumb, sizeof(float), 3 * n, fd);
+  fwrite(p->lastthumb, sizeof(float), 3 * n, fd);
+  fwrite(p->firsthistory, sizeof(float), p->history * n, fd);
+  fwrite(p->lasthistory, sizeof(float), p->history * n, fd);
+  for(int f = p->first; f <= p->last && p->tileh > 0; f++) {
+    if(!tileread(f)) memset(tile, 0, TILEW * tileh * 3);
+    fwrite(tile, TILEW * tileh * 3, 1, fd);
+  }
+  int ok = !ferror(fd);
+  fclose(fd);
+  if(!ok) {
+    printf("CutDetective: Failed writing %s\n", path);
+  }
+  return ok;
+}
+
+// Read a partial result file back
+int readpart(const char *path, Part *p) {
+  FILE *fd = fopen(path, "rb");
+  if(fd == NULL) {
+    printf("CutDetective: Failed to open %s\n", path);
+    return 0;
+  }
+  char magic[8];
+  int header[10];
+  int ok = fread(magic, 1, 8, fd) == 8 && !memcmp(magic, PARTMAGIC, 8);
+  ok = ok && fread(header, sizeof(int), 10, fd) == 10;
+  p->total = header[0];
+  p->first = header[1];
+  p->last = header[2];
+  p->width = header[3];
+  p->height = header[4];
+  p->downres = header[5];
+  p->radius = header[6];
+  p->history = header[7];
+  p->box = header[8];
+  p->tileh = header[9];
+  ok = ok && fread(&p->ncurves, sizeof(int), 1, fd) == 1;
+  ok = ok && p->first >= 0 && p->last >= p->first && p->last < p->total && p->downres > 0;
+  ok = ok && p->ncurves >= 0 && p->ncurves <= (int) NPARTCURVES && p->history > 0;
+  if(!ok) {
+    printf("CutDetective: %s isn't a partial result file\n", path);
+    fclose(fd);
+    return 0;
+  }
+  int frames = p->last - p->first + 1;
+  for(int c = 0; c < p->ncurves && ok; c++) {
+    p->values[c] = (float *) malloc(frames * sizeof(float));
+    ok = fread(&p->controls[c], sizeof(int), 1, fd) == 1;
+    ok = ok && fread(p->values[c], sizeof(float), frames, fd) == (size_t) frames;
+  }
+  int n = ((p->width - 1) / p->downres) * ((p->height - 1) / p->downres);
+  p->firstthumb = (float *) malloc(3 * n * sizeof(float));
+  p->lastthumb = (float *) malloc(3 * n * sizeof(float));
+  p->firsthistory = (float *) malloc(p->history * n * sizeof(float));
+  p->lasthistory = (float *) malloc(p->history * n * sizeof(float));
+  ok = ok && fread(p->firstthumb, sizeof(float), 3 * n, fd) == (size_t)(3 * n);
+  ok = ok && fread(p->lastthumb, sizeof(float), 3 * n, fd) == (size_t)(3 * n);
+  ok = ok && fread(p->firsthistory, sizeof(float), p->history * n, fd) == (size_t)(p->history * n);
+  ok = ok && fread(p->lasthistory, sizeof(float), p->history * n, fd) == (size_t)(p->history * n);
+  p->path = path;
+  p->tiles = ftell(fd);
+  if(ok && p->tileh > 0) {
+    fseek(fd, 0, SEEK_END);
+    ok = ftell(fd) - p->tiles >= (long) frames * TILEW * p->tileh * 3;
+  }
+  fclose(fd);
+  if(!ok) {
+    printf("CutDetective: %s is too short\n", path);
+  }
+  return ok;
+}
+
+// Analyse frames first to last as Flame would, with the front buffer
+// holding each frame in turn.  If p isn't NULL, keep the thumbnails a
+// partial result needs as we go
+int analyse(int first, int last, Part *p) {
+  SparkInfoStruct si;
+  memset(&si, 0, sizeof(si));
+  si.FrameWidth = width;
+  si.FrameHeight = height;
+  si.FrameBytes = width * height * pixelbytes;
+  si.TotalFrameNo = npaths;
+
+  SparkMemBufStruct front;
+  sparkMemGetBuffer(2, &front);
+  int n = 0;
+  for(int f = first; f <= last; f++) {
+    if(!loadframe(f, buffers[2])) return 0;
+    si.FrameNo = f;
+    if(SparkAnalyse(si) == NULL) return 0;
+
+    // Once SparkAnalyse is done with a frame its thumbnail is prevthumb
+    if(p != NULL) {
+      if(n == 0) {
+        n = thumbw * thumbh;
+        p->firstthumb = (float *) malloc(3 * n * sizeof(float));
+        p->lastthumb = (float *) malloc(3 * n * sizeof(float));
+        p->firsthistory = (float *) malloc(p->history * n * sizeof(float));
+        p->lasthistory = (float *) malloc(p->history * n * sizeof(float));
+      }
+      if(f == first) memcpy(p->firstthumb, prevthumb, 3 * n * sizeof(float));
+      if(f == last) memcpy(p->lastthumb, prevthumb, 3 * n * sizeof(float));
+      if(f - first < p->history) memcpy(p->firsthistory + (f - first) * n, prevthumb, n * sizeof(float));
+      if(last - f < p->history) memcpy(p->lasthistory + (p->history - 1 - (last - f)) * n, prevthumb, n * sizeof(float));
+    }
+    if(f % 100 == 0) {
+      printf("CutDetective: Analysed frame %d of %d\n", f, last);
+    }
+  }
+  si.FrameNo = last;
+  SparkAnalyseEnd(si);
+  return 1;
+}
+
+// Histograms of a whole thumbnail, without a region of interest
+void thumbhist(float *t, int *h) {
+  int n = thumbw * thumbh;
+  memset(h, 0, HISTBINS * sizeof(int));
+  for(int i = 0; i < n; i++) {
+    histcount(h, t[i], t[n + i], t[2 * n + i]);
+  }
+}
+
+int compareparts(const void *a, const void *b) {
+  return ((Part *) a)->first - ((Part *) b)->first;
+}
+
+// Stitch partial results together.  Each shard couldn't see the frame
+// before its range, so the pair across each seam is scored again from the
+// stored thumbnails, and the flash history after each seam is redone from
+// the luma planes either side.  Adaptive thresholds depend on everything
+// before them, so they're worked out again over the whole clip
+int merge(char **partpaths, int nparts) {
+  Part *parts = (Part *) calloc(nparts, sizeof(Part));
+  for(int i = 0; i < nparts; i++) {
+    if(!readpart(partpaths[i], &parts[i])) return 0;
+  }
+  qsort(parts, nparts, sizeof(Part), compareparts);
+  Part *p0 = &parts[0];
+  for(int i = 0; i < nparts; i++) {
+    Part *p = &parts[i];
+    if(p->total != p0->total || p->width != p0->width || p->height != p0->height || p->downres != p0->downres || p->radius != p0->radius || p->history != p0->history || p->box != p0->box || p->tileh != p0->tileh) {
+      printf("CutDetective: %s was analysed from a different clip or with different settings\n", partpaths[i]);
+      return 0;
+    }
+    int expected = i == 0 ? 0 : parts[i - 1].last + 1;
+    if(p->first != expected) {
+      printf("CutDetective: Expected a part starting at frame %d, got one starting at %d\n", expected, p->first);
+      return 0;
+    }
+    if(p->last - p->first + 1 < p->history) {
+      printf("CutDetective: Part starting at frame %d is shorter than the flash history, make it at least %d frames\n", p->first, p->history);
+      return 0;
+    }
+  }
+  if(parts[nparts - 1].last != p0->total - 1) {
+    printf("CutDetective: Parts stop at frame %d, clip has %d frames\n", parts[nparts - 1].last, p0->total);
+    return 0;
+  }
+
+  // Same setup as the shards had
+  int total = p0->total;
+  SparkSetupInt15.Value = p0->downres;
+  SparkSetupInt16.Value = p0->radius;
+  SparkSetupInt19.Value = 0;
+  SparkSetupInt20.Value = p0->history - 1;
+  SparkSetupInt21.Value = p0->box;
+  thumbw = (p0->width - 1) / p0->downres;
+  thumbh = (p0->height - 1) / p0->downres;
+  activesamples = thumbw * thumbh;
+  lumasamples = (p0->width / p0->downres) * (p0->height / p0->downres);
+  int n = thumbw * thumbh;
+
+  // Tiles for the contact sheet, if every part has them
+  int havetiles = 1;
+  for(int i = 0; i < nparts; i++) {
+    if(parts[i].tileh == 0) havetiles = 0;
+  }
+  if(havetiles) {
+    tilestart(total);
+  }
+  if(tilefile != NULL && tileh == p0->tileh) {
+    for(int i = 0; i < nparts; i++) {
+      Part *p = &parts[i];
+      FILE *fd = fopen(p->path, "rb");
+      if(fd == NULL) {
+        printf("CutDetective: Failed to open %s\n", p->path);
+        continue;
+      }
+      fseek(fd, p->tiles, SEEK_SET);
+      for(int f = p->first; f <= p->last; f++) {
+        if(fread(tile, TILEW * tileh * 3, 1, fd) != 1) break;
+        tilewrite(f);
+      }
+      fclose(fd);
+    }
+  }
+
+  for(int i = 0; i < nparts; i++) {
+    Part *p = &parts[i];
+    for(int c = 0; c < p->ncurves; c++) {
+      for(int f = p->first; f <= p->last; f++) {
+        sparkSetCurveKey(SPARK_UI_CONTROL, p->controls[c], f + 1, p->values[c][f - p->first]);
+      }
+    }
+  }
+
+  prevthumb = (float *) malloc(3 * n * sizeof(float));
+  thumb = (float *) malloc(3 * n * sizeof(float));
+  ringsize = p0->history;
+  ring = (float *) malloc(ringsize * n * sizeof(float));
+  edgealloc();
+  for(int i = 1; i < nparts; i++) {
+    Part *before = &parts[i - 1];
+    Part *p = &parts[i];
+    memcpy(prevthumb, before->lastthumb, 3 * n * sizeof(float));
+    memcpy(thumb, p->firstthumb, 3 * n * sizeof(float));
+    thumbhist(prevthumb, prevhist);
+    thumbhist(thumb, hist);
+    edgemap(prevthumb, prevedges);
+    edgemap(thumb, edges);
+    memcpy(ring, before->lasthistory, ringsize * n * sizeof(float));
+    ringhead = 0;
+    ringcount = ringsize;
+    scoreframe(p->first + 1);
+    ringpush();
+    for(int k = 1; k < p->history; k++) {
+      memcpy(thumb, p->firsthistory + k * n, n * sizeof(float));
+      flashframe(p->first + k + 1);
+      ringpush();
+    }
+  }
+  free(prevthumb);
+  free(thumb);
+  free(ring);
+  edgefree();
+
+  adaptivecurves(total);
+  sortdifferences(total);
+  sparkSetCurveKey(SPARK_UI_CONTROL, 22, 0, sparkGetCurveValuef(SPARK_UI_CONTROL, 22, 0));
+  sparkSetCurveKey(SPARK_UI_CONTROL, 23, 0, sparkGetCurveValuef(SPARK_UI_CONTROL, 23, 0));
+
+  for(int i = 0; i < nparts; i++) {
+    for(int c = 0; c < parts[i].ncurves; c++) {
+      free(parts[i].values[c]);
+    }
+    free(parts[i].firstthumb);
+    free(parts[i].lastthumb);
+    free(parts[i].firsthistory);
+    free(parts[i].lasthistory);
+  }
+  free(parts);
+  return total;
+}
+
+// Analyse frames first to last of the clip in paths as a shard, and write
+// the partial result.  A shard can't know about what comes before it, so
+// there's no letterbox finding, and the EDL is only written when merging
+int analysepart(int first, int last, const char *partpath) {
+  SparkSetupInt19.Value = 0;
+  SparkBoolean12.Value = 0;
+  rangefirst = first;
+  rangelast = last;
+  SparkMemoryTempBuffers();
+  Part p;
+  memset(&p, 0, sizeof(p));
+  p.total = npaths;
+  p.first = first;
+  p.last = last;
+  p.width = width;
+  p.height = height;
+  p.downres = SparkSetupInt15.Value;
+  p.radius = SparkSetupInt16.Value;
+  p.history = SparkSetupInt20.Value + 1;
+  p.box = SparkSetupInt21.Value;
+  return analyse(first, last, &p) && writepart(partpath, &p);
+}
+
+// Batch mode.  Clips are cut into chunks which are analysed as shards and
+// merged, so a long clip keeps every worker busy rather than one.  The
+// analysis keeps its state in globals, so each chunk runs in a process of
+// its own, forked from a scheduler which hands out chunks from one queue
+// whenever a worker is free.  Clips go in longest first, so the long ones
+// get started early and the short ones fill in at the end.  Merges go on
+// the front when a clip's last chunk finishes, so EDLs come out as soon as
+// they can and the partial results don't pile up
+
+#define TASKWHOLE 0
+#define TASKCHUNK 1
+#define TASKMERGE 2
+
+typedef struct {
+  char *path;
+  char *edl;
+  int frames;
+  int chunks;
+  int done, failed;
+} Clip;
+
+typedef struct {
+  int type;
+  int clip;
+  int chunk;
+  int first, last;
+} Task;
+
+typedef struct {
+  Task *tasks;
+  int head, tail, allocated;
+} Queue;
+
+Clip *clips = NULL;
+int nclips = 0;
+char batchparts[4096];
+pid_t scheduler;
+
+void queuepush(Queue *q, Task t) {
+  if(q->tail == q->allocated) {
+    // Slide everything back to the start before growing
+    memmove(q->tasks, q->tasks + q->head, (q->tail - q->head) * sizeof(Task));
+    q->tail -= q->head;
+    q->head = 0;
+    if(q->tail == q->allocated) {
+      q->allocated = q->allocated ? 2 * q->allocated : 64;
+      q->tasks = (Task *) realloc(q->tasks, q->allocated * sizeof(Task));
+    }
+  }
+  q->tasks[q->tail++] = t;
+}
+
+// Put t next in line
+void queuefirst(Queue *q, Task t) {
+  if(q->head == 0) {
+    queuepush(q, t);
+    memmove(q->tasks + 1, q->tasks, (q->tail - 1) * sizeof(Task));
+    q->tasks[0] = t;
+    return;
+  }
+  q->tasks[--q->head] = t;
+}
+
+int queuetake(Queue *q, Task *t) {
+  if(q->tail == q->head) return 0;
+  *t = q->tasks[q->head++];
+  return 1;
+}
+
+// Where chunk c of clip i keeps its partial result
+void partname(char *name, int clip, int chunk) {
+  sprintf(name, "%s/cutdetective.%d.%d.%d.cdpart", batchparts, (int) scheduler, clip, chunk);
+}
+
+// Whether a clip already added writes edl
+int edltaken(const char *edl) {
+  for(int i = 0; i < nclips; i++) {
+    if(clips[i].edl != NULL && !strcmp(clips[i].edl, edl)) return 1;
+  }
+  return 0;
+}
+
+// Add the clips named by input: a sequence, or a directory with no frames
+// in it whose subdirectories are sequences
+void addclip(const char *input, const char *edldir) {
+  DIR *dir = opendir(input);
+  if(dir != NULL) {
+    int frames = 0, allocated = 64, nsubs = 0;
+    char **subs = (char **) malloc(allocated * sizeof(char *));
+    struct dirent *d;
+    while((d = readdir(dir)) != NULL) {
+      int len = strlen(d->d_name);
+      if(len >= 4 && (!strcmp(d->d_name + len - 4, ".ppm") || !strcmp(d->d_name + len - 4, ".pfm"))) {
+        frames++;
+        continue;
+      }
+      if(d->d_name[0] == '.') continue;
+      char *sub = (char *) malloc(strlen(input) + len + 2);
+      sprintf(sub, "%s/%s", input, d->d_name);
+      DIR *subdir = opendir(sub);
+      if(subdir == NULL) {
+        free(sub);
+        continue;
+      }
+      closedir(subdir);
+      if(nsubs == allocated) {
+        allocated *= 2;
+        subs = (char **) realloc(subs, allocated * sizeof(char *));
+      }
+      subs[nsubs++] = sub;
+    }
+    closedir(dir);
+    if(frames == 0 && nsubs > 0) {
+      qsort(subs, nsubs, sizeof(char *), comparepaths);
+      for(int i = 0; i < nsubs; i++) {
+        addclip(subs[i], edldir);
+      }
+    }
+    for(int i = 0; i < nsubs; i++) {
+      free(subs[i]);
+    }
+    free(subs);
+    if(frames == 0 && nsubs > 0) return;
+  }
+
+  // EDLs are named after the clip, like Save EDL names them after the path
+  // it's given.  Clips with the same name, like the same reel from two
+  // days, get the folder they're in put in front.  If that's the same
+  // too, the clip is left out rather than write over another's EDL
+  clips = (Clip *) realloc(clips, (nclips + 1) * sizeof(Clip));
+  Clip *c = &clips[nclips];
+  memset(c, 0, sizeof(Clip));
+  c->path = strdup(input);
+  int len = strlen(c->path);
+  while(len > 1 && c->path[len - 1] == '/') c->path[--len] = '\0';
+  char *pathdup = strdup(c->path);
+  char *base = basename(pathdup);
+  char *dot = strrchr(base, '.');
+  if(dot != NULL && dot != base) *dot = '\0';
+  c->edl = (char *) malloc(strlen(edldir) + strlen(base) + 6);
+  sprintf(c->edl, "%s/%s.edl", edldir, base);
+  if(edltaken(c->edl)) {
+    char *full = realpath(c->path, NULL);
+    char *parent = full != NULL ? basename(dirname(full)) : NULL;
+    free(c->edl);
+    c->edl = NULL;
+    if(parent != NULL && strcmp(parent, "/") && strcmp(parent, ".")) {
+      c->edl = (char *) malloc(strlen(edldir) + strlen(parent) + strlen(base) + 7);
+      sprintf(c->edl, "%s/%s_%s.edl", edldir, parent, base);
+    }
+    if(c->edl == NULL || edltaken(c->edl)) {
+      printf("CutDetective: %s would write over another clip's EDL, leaving it out\n", c->path);
+      free(c->edl);
+      c->edl = NULL;
+    }
+    free(full);
+  }
+  free(pathdup);
+  nclips++;
+}
+
+// Run one task in this process, which is a fork of the scheduler
+int runtask(Task *t, int tenbit) {
+  Clip *c = &clips[t->clip];
+  snprintf(SparkString11.Value, sizeof(SparkString11.Value), "%s", c->edl);
+  SparkInfoStruct si;
+  memset(&si, 0, sizeof(si));
+  if(t->type == TASKMERGE) {
+    char **parts = (char **) malloc(c->chunks * sizeof(char *));
+    for(int k = 0; k < c->chunks; k++) {
+      parts[k] = (char *) malloc(4200);
+      partname(parts[k], t->clip, k);
+    }
+    si.TotalFrameNo = merge(parts, c->chunks);
+    if(si.TotalFrameNo == 0) return 0;
+    savebuttoncallback(0, si);
+    return 1;
+  }
+  if(!findframes(c->path) || !findformat(tenbit)) return 0;
+  if(t->type == TASKCHUNK) {
+    char part[4200];
+    partname(part, t->clip, t->chunk);
+    return analysepart(t->first, t->last, part);
+  }
+  rangefirst = 0;
+  rangelast = npaths - 1;
+  SparkMemoryTempBuffers();
+  if(!analyse(0, npaths - 1, NULL)) return 0;
+  si.TotalFrameNo = npaths;
+  if(!SparkBoolean12.Value) {
+    savebuttoncallback(0, si);
+  }
+  return 1;
+}
+
+// Analyse every clip named in inputs, jobs at a time, in chunks of at
+// least chunk frames
+int runbatch(char **inputs, int ninputs, int jobs, int chunk, int tenbit) {
+  // Chunks are analysed as shards, so the same limits apply
+  SparkSetupInt19.Value = 0;
+  SparkBoolean35.Value = 0;
+  if(chunk < SparkSetupInt20.Value + 1) {
+    chunk = SparkSetupInt20.Value + 1;
+  }
+  char *edldir = strdup(SparkString11.Value);
+  struct stat st;
+  if(stat(edldir, &st) != 0 || !S_ISDIR(st.st_mode)) {
+    // Not a directory, so use the one the default EDL is in
+    free(edldir);
+    char *pathdup = strdup(SparkString11.Value);
+    edldir = strdup(dirname(pathdup));
+    free(pathdup);
+  }
+  snprintf(batchparts, sizeof(batchparts), "%s", edldir);
+  scheduler = getpid();
+  for(int i = 0; i < ninputs; i++) {
+    addclip(inputs[i], edldir);
+  }
+  free(edldir);
+
+  // Cut each clip into equal chunks, and queue them longest clip first
+  Queue queue;
+  memset(&queue, 0, sizeof(queue));
+  int *order = (int *) malloc(nclips * sizeof(int));
+  int ntasks = 0, failed = 0;
+  for(int i = 0; i < nclips; i++) {
+    order[i] = i;
+    if(clips[i].edl == NULL) {
+      failed++;
+      continue;
+    }
+    if(findframes(clips[i].path)) {
+      clips[i].frames = npaths;
+    } else {
+      failed++;
+    }
+    freeframes();
+  }
+  for(int i = 1; i < nclips; i++) {
+    for(int j = i; j > 0 && clips[order[j]].frames > clips[order[j - 1]].frames; j--) {
+      int o = order[j];
+      order[j] = order[j - 1];
+      order[j - 1] = o;
+    }
+  }
+  for(int i = 0; i < nclips; i++) {
+    Clip *c = &clips[order[i]];
+    if(c->frames == 0) continue;
+    c->chunks = c->frames / chunk;
+    if(c->chunks < 1) c->chunks = 1;
+    for(int k = 0; k < c->chunks; k++) {
+      Task t;
+      t.type = c->chunks == 1 ? TASKWHOLE : TASKCHUNK;
+      t.clip = order[i];
+      t.chunk = k;
+      t.first = (long long) k * c->frames / c->chunks;
+      t.last = (long long)(k + 1) * c->frames / c->chunks - 1;
+      queuepush(&queue, t);
+      ntasks++;
+    }
+  }
+  printf("CutDetective: %d clips in %d chunks, %d at a time\n", nclips - failed, ntasks, jobs);
+  fflush(stdout);
+
+  pid_t *running = (pid_t *) calloc(jobs, sizeof(pid_t));
+  Task *current = (Task *) calloc(jobs, sizeof(Task));
+  int busy = 0, forkfailed = 0, retries = 0;
+  while(1) {
+    for(int w = 0; w < jobs; w++) {
+      if(running[w] != 0 || !queuetake(&queue, &current[w])) continue;
+      pid_t pid = fork();
+      if(pid == 0) {
+        int ok = runtask(&current[w], tenbit);
+        fflush(stdout);
+        _exit(ok ? 0 : 1);
+      }
+      if(pid < 0) {
+        printf("CutDetective: Failed to start a worker\n");
+        queuefirst(&queue, current[w]);
+        forkfailed = 1;
+        break;
+      }
+      running[w] = pid;
+      busy++;
+      retries = 0;
+    }
+    if(busy == 0) {
+      if(!forkfailed) break;
+      // Nothing running to wait for, so back off and try again, and give
+      // up on whatever's left if it keeps failing
+      forkfailed = 0;
+      if(++retries <= 10) {
+        sleep(1);
+        continue;
+      }
+      char *abandoned = (char *) calloc(nclips, 1);
+      Task t;
+      while(queuetake(&queue, &t)) {
+        abandoned[t.clip] = 1;
+      }
+      for(int i = 0; i < nclips; i++) {
+        if(!abandoned[i]) continue;
+        printf("CutDetective: %s failed, no EDL written\n", clips[i].path);
+        failed++;
+        for(int k = 0; k < clips[i].chunks; k++) {
+          char part[4200];
+          partname(part, i, k);
+          unlink(part);
+        }
+      }
+      free(abandoned);
+      break;
+    }
+
+    int status;
+    pid_t pid = wait(&status);
+    if(pid < 0) break;
+    int w = 0;
+    while(w < jobs && running[w] != pid) w++;
+    if(w == jobs) continue;
+    running[w] = 0;
+    busy--;
+    int ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    Task *t = &current[w];
+    Clip *c = &clips[t->clip];
+    int cleanup = 0;
+    if(t->type == TASKCHUNK) {
+      if(ok) c->done++;
+      else c->failed++;
+      if(c->done + c->failed == c->chunks) {
+        if(c->failed == 0) {
+          Task m = *t;
+          m.type = TASKMERGE;
+          queuefirst(&queue, m);
+        } else {
+          ok = 0;
+          cleanup = 1;
+        }
+      }
+    } else if(t->type == TASKMERGE) {
+      cleanup = 1;
+    }
+    if(!ok && (t->type != TASKCHUNK || cleanup)) {
+      printf("CutDetective: %s failed, no EDL written\n", c->path);
+      failed++;
+    }
+    if(cleanup) {
+      for(int k = 0; k < c->chunks; k++) {
+        char part[4200];
+        partname(part, t->clip, k);
+        unlink(part);
+      }
+    }
+    fflush(stdout);
+  }
+
+  printf("CutDetective: Batch done, %d of %d clips failed\n", failed, nclips);
+  free(running);
+  free(current);
+  free(order);
+  free(queue.tasks);
+  return failed == 0;
+}
+
+// Score only the pairs of frames listed in listpath, one pair per line,
+// or a single frame to score it against the one before it.  Each pair is
+// printed with whether the picked metric makes it a cut or a duplicate
+int checkpairs(const char *listpath) {
+  FILE *fd = fopen(listpath, "r");
+  if(fd == NULL) {
+    printf("CutDetective: Failed to open %s\n", listpath);
+    return 0;
+  }
+  int npairs = 0, allocated = 256;
+  FramePair *pairs = (FramePair *) malloc(allocated * sizeof(FramePair));
+  char line[256];
+  while(fgets(line, sizeof(line), fd) != NULL) {
+    int a, b;
+    int got = sscanf(line, "%d %d", &a, &b);
+    if(got < 1) continue;
+    if(got == 1) {
+      b = a;
+      a = a > 0 ? a - 1 : 0;
+    }
+    if(a < 0 || b < 0 || a >= npaths || b >= npaths) {
+      printf("CutDetective: Frames in %s must be within 0 to %d\n", listpath, npaths - 1);
+      fclose(fd);
+      free(pairs);
+      return 0;
+    }
+    if(npairs == allocated) {
+      allocated *= 2;
+      pairs = (FramePair *) realloc(pairs, allocated * sizeof(FramePair));
+    }
+    memset(&pairs[npairs], 0, sizeof(FramePair));
+    pairs[npairs].a = a;
+    pairs[npairs].b = b;
+    npairs++;
+  }
+  fclose(fd);
+  if(npairs == 0) {
+    printf("CutDetective: No frames listed in %s\n", listpath);
+    free(pairs);
+    return 0;
+  }
+
+  rangefirst = 0;
+  rangelast = npaths - 1;
+  SparkMemoryTempBuffers();
+  int reads = scorepairs(pairs, npairs);
+  if(reads < 0) {
+    free(pairs);
+    return 0;
+  }
+  printf("%7s %7s %8s %8s %8s %8s %8s %8s %8s\n", "a", "b", "luma", "motion", "histo", "chroma", "changed", "gain", "edges");
+  for(int i = 0; i < npairs; i++) {
+    FramePair *p = &pairs[i];
+    float metrics[] = { p->luma, p->motion, p->histogram, p->chroma, p->changed, p->gain, p->edges };
+    float difference = metrics[SparkPup20.Value];
+    const char *verdict = "";
+    if(difference > sparkGetCurveValuef(SPARK_UI_CONTROL, 22, p->b + 1)) verdict = "cut";
+    else if(difference < sparkGetCurveValuef(SPARK_UI_CONTROL, 23, p->b + 1)) verdict = "dup";
+    printf("%7d %7d %8.3f %8.3f %8.3f %8.3f %8.3f %8.3f %8.3f %s\n", p->a, p->b, p->luma, p->motion, p->histogram, p->chroma, p->changed, p->gain, p->edges, verdict);
+  }
+  printf("CutDetective: Scored %d pairs from %d frame reads\n", npairs, reads);
+  free(pairs);
+  return 1;
+}
+
+// Seconds since the epoch, for timing
+double seconds(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+// Fill a buffer with a smooth picture plus per-pixel grain, different
+// grain for each seed, and fine stripes to alias
+void benchframe(unsigned char *buffer, int d, int seed) {
+  unsigned int state = 2463534242u + seed;
+  for(int y = 0; y < height; y++) {
+    for(int x = 0; x < width; x++) {
+      state ^= state << 13;
+      state ^= state >> 17;
+      state ^= state << 5;
+      float grain = ((state & 0xffff) / 65535.0 - 0.5) * 0.1;
+      float stripes = ((x / 2 + y / 3) & 1) * 0.1;
+      float r = 0.3 + 0.4 * x / width + stripes + grain;
+      float g = 0.2 + 0.5 * y / height + grain;
+      float b = 0.6 - 0.3 * x / width + stripes + grain;
+      writepixel((char *) buffer + (y * width + x) * pixelbytes, d, r, g, b);
+    }
+  }
+}
+
+// Time point and box sampled thumbnails of a big frame in each pixel
+// format, and how much two frames differing only in grain differ by
+// each way, which is the noise the difference curve would show
+int bench(void) {
+  const char *names[] = { "8-bit", "10-bit", "12-bit", "half" };
+  int depths[] = { SPARKBUF_RGB_24_3x8, SPARKBUF_RGB_48_3x10, SPARKBUF_RGB_48_3x12, SPARKBUF_RGB_48_3x16_FP };
+  int downres = SparkSetupInt15.Value;
+  thumbw = (width - 1) / downres;
+  thumbh = (height - 1) / downres;
+  activesamples = thumbw * thumbh;
+  int n = thumbw * thumbh;
+  float *a = (float *) malloc(3 * n * sizeof(float));
+  float *b = (float *) malloc(3 * n * sizeof(float));
+  int h[HISTBINS];
+  printf("%dx%d, downres %d, ms per frame and grain difference\n", width, height, downres);
+  printf("%-8s %10s %10s %10s %10s\n", "", "point ms", "box ms", "point", "box");
+  for(int f = 0; f < 4; f++) {
+    depth = depths[f];
+    pixelbytes = depth == SPARKBUF_RGB_24_3x8 ? 3 : 6;
+    unsigned char *frames[2];
+    for(int j = 0; j < 2; j++) {
+      frames[j] = (unsigned char *) malloc((size_t) width * height * pixelbytes);
+      if(frames[j] == NULL) {
+        printf("CutDetective: Failed to allocate a %dx%d frame\n", width, height);
+        return 0;
+      }
+      benchframe(frames[j], depth, j);
+    }
+    SparkMemBufStruct buf;
+    memset(&buf, 0, sizeof(buf));
+    buf.BufWidth = width;
+    buf.BufHeight = height;
+    buf.BufDepth = depth;
+    buf.Stride = width * pixelbytes;
+    buf.Inc = pixelbytes;
+    buf.BufSize = width * height * pixelbytes;
+    double ms[2], noise[2];
+    for(int box = 0; box < 2; box++) {
+      SparkSetupInt21.Value = box;
+      int runs = 0;
+      double start = seconds(), took;
+      do {
+        buf.Buffer = (unsigned long *) frames[runs & 1];
+        makethumb(&buf, downres, a, h);
+        runs++;
+        took = seconds() - start;
+      } while(took < 0.5 || runs < 4);
+      ms[box] = 1000.0 * took / runs;
+      buf.Buffer = (unsigned long *) frames[0];
+      makethumb(&buf, downres, a, h);
+      buf.Buffer = (unsigned long *) frames[1];
+      makethumb(&buf, downres, b, h);
+      double sum = 0.0;
+      for(int i = 0; i < n; i++) {
+        sum += fabs(a[i] - b[i]);
+      }
+      noise[box] = 100.0 * sum / n;
+    }
+    printf("%-8s %10.2f %10.2f %10.3f %10.3f\n", names[f], ms[0], ms[1], noise[0], noise[1]);
+    free(frames[0]);
+    free(frames[1]);
+  }
+  free(a);
+  free(b);
+  return 1;
+}
+
+void usage(void) {
+  printf("Usage: cutdetective [options] frames\n");
+  printf("       cutdetective [options] -range first last -part shard.cdpart frames\n");
+  printf("       cutdetective [options] -merge shard1.cdpart shard2.cdpart ...\n");
+  printf("       cutdetective [options] -batch [-jobs n] [-chunk n] clips ...\n");
+  printf("       cutdetective [options] -pairs list frames\n");
+  printf("       cutdetective [options] -bench [width height]\n");
+  printf("Options:\n");
+  printf("  -edl path          EDL to write, default %s, or in batch mode\n", SparkString11.Value);
+  printf("                     the directory to write one per clip in\n");
+  printf("  -jobs n            batch mode workers, default one per core\n");
+  printf("  -chunk n           batch mode frames per chunk, default 1000\n");
+  printf("  -curves path       also write every curve as text\n");
+  printf("  -fps n             timecode rate, default %d\n", SparkInt25.Value);
+  printf("  -depth 10          16-bit PPMs hold 10-bit rather than 12-bit footage\n");
+  printf("  -metric n          0 luma, 1 motion-comp, 2 histogram, 3 chroma,\n");
+  printf("                     4 changed pixels, 5 gain-invariant, 6 edge change\n");
+  printf("  -cut f             cut threshold, default %.2f\n", SparkFloat22.Value);
+  printf("  -dup f             duplicate threshold, default %.2f\n", SparkFloat23.Value);
+  printf("  -tolerance f       changed pixel tolerance, default %.2f\n", SparkFloat31.Value);
+  printf("  -nocuts            don't detect cuts\n");
+  printf("  -dupes             remove duplicate frames\n");
+  printf("  -dissolves f       detect dissolves over threshold f\n");
+  printf("  -adaptive f        adaptive thresholds with sensitivity f\n");
+  printf("  -noflash           don't ignore flash frames\n");
+  printf("  -flash f           flash tolerance, default %.2f\n", SparkFloat43.Value);
+  printf("  -stream            write the EDL while analysing\n");
+  printf("  -shots             write a shot table next to the EDL\n");
+  printf("  -sheet             write a contact sheet next to the EDL\n");
+  printf("  -progress          publish progress for cutdetectivemonitor\n");
+  printf("  -checkpoint path   keep every frame's metrics in path, and reuse\n");
+  printf("                     those of frames which haven't changed\n");
+  printf("  -downres n         default %d\n", SparkSetupInt15.Value);
+  printf("  -radius n          motion search radius, default %d\n", SparkSetupInt16.Value);
+  printf("  -window n          adaptive window, default %d\n", SparkSetupInt17.Value);
+  printf("  -shortest n        shortest dissolve, default %d\n", SparkSetupInt18.Value);
+  printf("  -letterbox n       find letterbox and burn-ins over n frames\n");
+  printf("  -history n         flash history, default %d\n", SparkSetupInt20.Value);
+  printf("  -box               box filter thumbnails rather than point sample\n");
+}
+
+int main(int argc, char **argv) {
+  const char *partpath = NULL, *curvespath = NULL, *pairspath = NULL;
+  int merging = 0, tenbit = 0;
+  int batch = 0, jobs = sysconf(_SC_NPROCESSORS_ONLN), chunk = 1000;
+  int benching = 0;
+  width = 3840;
+  height = 2160;
+  rangefirst = -1;
+  rangelast = -1;
+  int i = 1;
+  for(; i < argc && argv[i][0] == '-'; i++) {
+    const char *o = argv[i];
+    int more = argc - i - 1;
+    if(!strcmp(o, "-edl") && more >= 1) snprintf(SparkString11.Value, sizeof(SparkString11.Value), "%s", argv[++i]);
+    else if(!strcmp(o, "-curves") && more >= 1) curvespath = argv[++i];
+    else if(!strcmp(o, "-fps") && more >= 1) SparkInt25.Value = atoi(argv[++i]);
+    else if(!strcmp(o, "-depth") && more >= 1) tenbit = atoi(argv[++i]) == 10;
+    else if(!strcmp(o, "-metric") && more >= 1) SparkPup20.Value = atoi(argv[++i]);
+    else if(!strcmp(o, "-cut") && more >= 1) SparkFloat22.Value = atof(argv[++i]);
+    else if(!strcmp(o, "-dup") && more >= 1) SparkFloat23.Value = atof(argv[++i]);
+    else if(!strcmp(o, "-tolerance") && more >= 1) SparkFloat31.Value = atof(argv[++i]);
+    else if(!strcmp(o, "-nocuts")) SparkBoolean15.Value = 0;
+    else if(!strcmp(o, "-dupes")) SparkBoolean16.Value = 1;
+    else if(!strcmp(o, "-dissolves") && more >= 1) {
+      SparkBoolean13.Value = 1;
+      SparkFloat14.Value = atof(argv[++i]);
+    }
+    else if(!strcmp(o, "-adaptive") && more >= 1) {
+      SparkBoolean17.Value = 1;
+      SparkFloat24.Value = atof(argv[++i]);
+    }
+    else if(!strcmp(o, "-noflash")) SparkBoolean8.Value = 0;
+    else if(!strcmp(o, "-flash") && more >= 1) SparkFloat43.Value = atof(argv[++i]);
+    else if(!strcmp(o, "-stream")) SparkBoolean12.Value = 1;
+    else if(!strcmp(o, "-progress")) SparkBoolean37.Value = 1;
+    else if(!strcmp(o, "-shots")) SparkBoolean39.Value = 1;
+    else if(!strcmp(o, "-sheet")) SparkBoolean42.Value = 1;
+    else if(!strcmp(o, "-checkpoint") && more >= 1) {
+      SparkBoolean35.Value = 1;
+      snprintf(SparkString36.Value, sizeof(SparkString36.Value), "%s", argv[++i]);
+    }
+    else if(!strcmp(o, "-downres") && more >= 1) SparkSetupInt15.Value = atoi(argv[++i]);
+    else if(!strcmp(o, "-radius") && more >= 1) SparkSetupInt16.Value = atoi(argv[++i]);
+    else if(!strcmp(o, "-window") && more >= 1) SparkSetupInt17.Value = atoi(argv[++i]);
+    else if(!strcmp(o, "-shortest") && more >= 1) SparkSetupInt18.Value = atoi(argv[++i]);
+    else if(!strcmp(o, "-letterbox") && more >= 1) SparkSetupInt19.Value = atoi(argv[++i]);
+    else if(!strcmp(o, "-history") && more >= 1) SparkSetupInt20.Value = atoi(argv[++i]);
+    else if(!strcmp(o, "-box")) SparkSetupInt21.Value = 1;
+    else if(!strcmp(o, "-range") && more >= 2) {
+      rangefirst = atoi(argv[++i]);
+      rangelast = atoi(argv[++i]);
+    }
+    else if(!strcmp(o, "-part") && more >= 1) partpath = argv[++i];
+    else if(!strcmp(o, "-merge")) merging = 1;
+    else if(!strcmp(o, "-batch")) batch = 1;
+    else if(!strcmp(o, "-jobs") && more >= 1) jobs = atoi(argv[++i]);
+    else if(!strcmp(o, "-chunk") && more >= 1) chunk = atoi(argv[++i]);
+    else if(!strcmp(o, "-pairs") && more >= 1) pairspath = argv[++i];
+    else if(!strcmp(o, "-bench")) {
+      benching = 1;
+      if(more >= 2 && isdigit(argv[i + 1][0])) {
+        width = atoi(argv[++i]);
+        height = atoi(argv[++i]);
+      }
+    }
+    else {
+      usage();
+      return 1;
+    }
+  }
+  if(benching) {
+    if(width < 2 * SparkSetupInt15.Value || height < 2 * SparkSetupInt15.Value) {
+      printf("CutDetective: -bench frame is too small for the downres\n");
+      return 1;
+    }
+    return bench() ? 0 : 1;
+  }
+  if(i >= argc || SparkPup20.Value < 0 || SparkPup20.Value >= SparkPup20.Count || jobs < 1) {
+    usage();
+    return 1;
+  }
+  if(SparkSetupInt15.Value < 1 || SparkSetupInt17.Value < 1 || SparkSetupInt17.Value > SparkSetupInt17.Max || SparkSetupInt20.Value < 2) {
+    printf("CutDetective: Setup values out of range\n");
+    return 1;
+  }
+
+  if(batch) {
+    return runbatch(argv + i, argc - i, jobs, chunk, tenbit) ? 0 : 1;
+  }
+
+  SparkInfoStruct si;
+  memset(&si, 0, sizeof(si));
+  if(merging) {
+    si.TotalFrameNo = merge(argv + i, argc - i);
+    if(si.TotalFrameNo == 0) return 1;
+  } else {
+    if(!findframes(argv[i]) || !findformat(tenbit)) return 1;
+    if(pairspath != NULL) {
+      return checkpairs(pairspath) ? 0 : 1;
+    }
+    if(partpath != NULL) {
+      if(rangefirst < 0 || rangelast < rangefirst || rangelast >= npaths) {
+        printf("CutDetective: -part needs a -range within 0 to %d\n", npaths - 1);
+        return 1;
+      }
+      if(!analysepart(rangefirst, rangelast, partpath)) return 1;
+      if(curvespath != NULL) writecurves(curvespath);
+      return 0;
+    }
+    // Analysing only part of the clip can still see the frame before it,
+    // just as in Flame
+    int first = rangefirst, last = rangelast;
+    if(first < 0) {
+      first = 0;
+      last = npaths - 1;
+    } else if(last < first || last >= npaths) {
+      printf("CutDetective: -range must be within 0 to %d\n", npaths - 1);
+      return 1;
+    }
+    rangefirst = 0;
+    rangelast = npaths - 1;
+    SparkMemoryTempBuffers();
+    if(!analyse(first, last, NULL)) return 1;
+    si.TotalFrameNo = npaths;
+  }
+
+  if(curvespath != NULL) writecurves(curvespath);
+  if(!SparkBoolean12.Value) {
+    savebuttoncallback(0, si);
+  }
+  return 0;
+}
@@ -0,0 +1,36 @@
+// Layout of the shared memory segment Cut Detective publishes its
+// progress in while analysing, shared with cutdetectivemonitor
+
+#ifndef CUTDETECTIVETELEMETRY_H
+#define CUTDETECTIVETELEMETRY_H
+
+// Segments are called this followed by the analysing process's pid
+#define TELEMETRYPREFIX "/cutdetective."
+#define TELEMETRYMAGIC "CDTELE1"
+#define TELEMETRYSLOTS 64
+
+// One update, published after each frame
+typedef struct {
+  int frame;
+  int total;
+  int analysed;
+  int cuts;
+  float fps;
+  float difference;
+  double updated;
+} TelemetryRecord;
+
+// The analysis is the only writer.  It fills in the next slot of the ring
+// then bumps written, so a reader takes the slot before written and
+// checks written again afterwards: if it has moved on by a whole ring the
+// slot may have been overwritten while we read it, so try again
+typedef struct {
+  char magic[8];
+  int pid;
+  int finished;
+  char edl[256];
+  unsigned long long written;
+  TelemetryRecord ring[TELEMETRYSLOTS];
+} TelemetrySegment;
+
+#endif
@@ -0,0 +1,55 @@
+// The parts of half which live in a library rather than half.h.  Inside
+// Flame the host provides these, this is only for the offline host
+
+#include "half.h"
+#include "halfTables.h"
+
+// Float bits to half bits, for the cases the _eLut fast path in half.h
+// can't manage: zeroes, denormals, infinities, NaNs and overflow
+short half::convert(int i) {
+  int s = (i >> 16) & 0x00008000;
+  int e = ((i >> 23) & 0x000000ff) - (127 - 15);
+  int m = i & 0x007fffff;
+
+  if(e <= 0) {
+    // Too small for a normalized half
+    if(e < -10) {
+      return s;
+    }
+    m = m | 0x00800000;
+    int t = 14 - e;
+    int a = (1 << (t - 1)) - 1;
+    int b = (m >> t) & 1;
+    m = (m + a + b) >> t;
+    return s | m;
+  } else if(e == 0xff - (127 - 15)) {
+    if(m == 0) {
+      // Infinity
+      return s | 0x7c00;
+    }
+    // NaN, keep the top bits of the significand but make sure it stays a NaN
+    m >>= 13;
+    return s | 0x7c00 | m | (m == 0);
+  } else {
+    // Round to nearest even
+    m = m + 0x00000fff + ((m >> 13) & 1);
+    if(m & 0x00800000) {
+      m = 0;
+      e += 1;
+    }
+    if(e > 30) {
+      overflow();
+      return s | 0x7c00;
+    }
+    return s | (e << 10) | (m >> 13);
+  }
+}
+
+// Provoke a float overflow, so anyone trapping those notices
+float half::overflow() {
+  volatile float f = 1e10;
+  for(int i = 0; i < 10; i++) {
+    f *= f;
+  }
+  return f;
+}
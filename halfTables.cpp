@@ -0,0 +1,55 @@
+// Prints the lookup tables half.h expects, as C++ for halfOffline.cpp.
+// Inside Flame these come from the host, this is only for the offline
+// host.  Same method as halfExport's toFloat and eLut generators
+
+#include <stdio.h>
+
+// Bit pattern of the float with the same value as half bit pattern y
+unsigned int halftofloat(unsigned short y) {
+  int s = (y >> 15) & 0x00000001;
+  int e = (y >> 10) & 0x0000001f;
+  int m = y & 0x000003ff;
+  if(e == 0) {
+    if(m == 0) {
+      // Plus or minus zero
+      return s << 31;
+    }
+    // Denormalized, renormalize it
+    while(!(m & 0x00000400)) {
+      m <<= 1;
+      e -= 1;
+    }
+    e += 1;
+    m &= ~0x00000400;
+  } else if(e == 31) {
+    // Infinity or NaN
+    return (s << 31) | 0x7f800000 | (m << 13);
+  }
+  e = e + (127 - 15);
+  m = m << 13;
+  return (s << 31) | (e << 23) | m;
+}
+
+int main(void) {
+  printf("// Generated by halfTables, don't edit\n\n");
+  printf("const half::uif half::_toFloat[1 << 16] = {\n");
+  for(int i = 0; i < (1 << 16); i++) {
+    printf("  {0x%08xu},\n", halftofloat(i));
+  }
+  printf("};\n\n");
+
+  // Exponent part of a half for each sign and float exponent, or 0 where
+  // the half would be zero, denormal, infinite or NaN and needs convert()
+  printf("const unsigned short half::_eLut[1 << 9] = {\n");
+  for(int i = 0; i < (1 << 9); i++) {
+    int e = (i & 0x0ff) - (127 - 15);
+    int s = (i & 0x100) << 7;
+    if(e <= 0 || e >= 30) {
+      printf("  0,\n");
+    } else {
+      printf("  0x%04x,\n", s | (e << 10));
+    }
+  }
+  printf("};\n");
+  return 0;
+}
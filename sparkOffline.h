@@ -0,0 +1,102 @@
+// Just enough of the Spark API for CutDetective.cpp to build without
+// Flame, for the offline host in CutDetectiveOffline.cpp.  Field names
+// and values follow spark.h but the layouts are our own, so objects built
+// against this can't be loaded into Flame
+
+#ifndef SPARKOFFLINE_H
+#define SPARKOFFLINE_H
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+typedef enum {
+  SPARKBUF_RGB_24_3x8,
+  SPARKBUF_RGB_48_3x10,
+  SPARKBUF_RGB_48_3x12,
+  SPARKBUF_RGB_48_3x16_FP
+} SparkPixelFormat;
+
+#define SPARK_MODULE 1
+#define SPARK_FRONT_CLIP 1
+#define SPARK_UI_CONTROL 1
+#define SPARK_FLAG_NO_INPUT 1
+#define SPARK_FLAG_NO_ANIM 2
+#define MEMBUF_LOCKED 4
+
+typedef struct {
+  int FrameWidth;
+  int FrameHeight;
+  int FrameBytes;
+  int FrameNo;
+  int TotalFrameNo;
+} SparkInfoStruct;
+
+typedef struct {
+  unsigned long *Buffer;
+  int BufWidth;
+  int BufHeight;
+  int BufDepth;
+  int BufSize;
+  int BufState;
+  int Stride;
+  int Inc;
+} SparkMemBufStruct;
+
+typedef unsigned long *(*SparkCallback)(int what, SparkInfoStruct si);
+
+typedef struct {
+  float Value;
+  float Min;
+  float Max;
+  float Increment;
+  int Flags;
+  char *Title;
+  SparkCallback Callback;
+} SparkFloatStruct;
+
+typedef struct {
+  int Value;
+  int Min;
+  int Max;
+  int Increment;
+  int Flags;
+  char *Title;
+  SparkCallback Callback;
+} SparkIntStruct;
+
+typedef struct {
+  int Value;
+  char *Title;
+  SparkCallback Callback;
+} SparkBooleanStruct;
+
+typedef struct {
+  char Value[4096];
+  char *Title;
+  int Flags;
+  SparkCallback Callback;
+} SparkStringStruct;
+
+typedef struct {
+  char *Title;
+  SparkCallback Callback;
+} SparkPushStruct;
+
+typedef struct {
+  int Value;
+  int Count;
+  const char **Titles;
+  SparkCallback Callback;
+} SparkPupStruct;
+
+int sparkMemRegisterBuffer(void);
+int sparkMemGetBuffer(int id, SparkMemBufStruct *b);
+void sparkCopyBuffer(unsigned long *from, unsigned long *to);
+int sparkGetFrame(int clip, int frame, unsigned long *buffer);
+void sparkSetCurveKey(int type, int control, int frame, float value);
+float sparkGetCurveValuef(int type, int control, int frame);
+void sparkControlUpdate(int control);
+void sparkMessage(char *message);
+
+#endif